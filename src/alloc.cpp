@@ -0,0 +1,181 @@
+#include <new>
+#include <mutex>
+#include <atomic>
+#include <cstdlib>
+#include <algorithm>
+
+#include <dlfcn.h>
+#include <cxxabi.h>
+#include <execinfo.h>
+
+#include "alloc.h"
+
+namespace
+{
+
+std::atomic<bool> enabled{false};
+std::atomic<unsigned int> sample_every{0};
+std::atomic<uint64_t> allocations{0};
+std::atomic<uint64_t> bytes{0};
+std::atomic<uint64_t> frees{0};
+
+// Filled with no allocation: fixed table, spin lock, and backtrace() warmed up by Enable()
+Alloc::Site sites[Alloc::SITES];
+std::size_t used = 0;
+std::atomic_flag busy = ATOMIC_FLAG_INIT;
+thread_local bool inside = false;               // backtrace() may allocate on some platforms
+
+void Sample(std::size_t size)
+{
+    if (inside)
+        return;
+    inside = true;
+
+    void * frames[Alloc::DEPTH + 2];
+    const auto depth = backtrace(frames, Alloc::DEPTH + 2);
+
+    // Skip Sample() and Count(), the sites start at operator new
+    Alloc::Site site{};
+    for (int i=2; i<depth; ++i)
+        site.frames[i - 2] = frames[i];
+
+    while (busy.test_and_set(std::memory_order_acquire))
+        ;
+    auto end = sites + used;
+    auto it = std::find_if(sites, end, [&site](const Alloc::Site & s) { return std::equal(s.frames, s.frames + Alloc::DEPTH, site.frames); });
+    if (it == end && used < Alloc::SITES)
+    {
+        *it = site;
+        ++used;
+    }
+    if (it != sites + Alloc::SITES)
+    {
+        ++it->samples;
+        it->bytes += size;
+    }
+    busy.clear(std::memory_order_release);
+
+    inside = false;
+}
+
+void Count(std::size_t size)
+{
+    if (!enabled.load(std::memory_order_relaxed))
+        return;
+
+    const auto n = allocations.fetch_add(1, std::memory_order_relaxed);
+    bytes.fetch_add(size, std::memory_order_relaxed);
+
+    const auto every = sample_every.load(std::memory_order_relaxed);
+    if (every && n % every == 0)
+        Sample(size);
+}
+
+}
+
+// The array, nothrow and sized forms of the standard library all end up in these
+void * operator new(std::size_t size)
+{
+    Count(size);
+    if (auto p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void * operator new(std::size_t size, std::align_val_t align)
+{
+    Count(size);
+    const auto a = std::max(std::size_t(align), sizeof(void *));
+    if (auto p = std::aligned_alloc(a, (size + a - 1) / a * a))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void * p) noexcept
+{
+    if (p && enabled.load(std::memory_order_relaxed))
+        frees.fetch_add(1, std::memory_order_relaxed);
+    std::free(p);
+}
+
+void operator delete(void * p, std::align_val_t) noexcept
+{
+    operator delete(p);
+}
+
+void operator delete(void * p, std::size_t) noexcept
+{
+    operator delete(p);
+}
+
+void operator delete(void * p, std::size_t, std::align_val_t) noexcept
+{
+    operator delete(p);
+}
+
+namespace Alloc
+{
+
+void Enable(unsigned int every)
+{
+    // The first backtrace() loads the unwinder, which allocates
+    void * warmup[2];
+    backtrace(warmup, 2);
+
+    sample_every = every;
+    enabled = true;
+}
+
+void Disable()
+{
+    enabled = false;
+}
+
+void Clear()
+{
+    allocations = 0;
+    bytes = 0;
+    frees = 0;
+
+    while (busy.test_and_set(std::memory_order_acquire))
+        ;
+    used = 0;
+    busy.clear(std::memory_order_release);
+}
+
+uint64_t Allocations() { return allocations; }
+uint64_t Bytes() { return bytes; }
+uint64_t Frees() { return frees; }
+
+std::vector<Site> Sites()
+{
+    while (busy.test_and_set(std::memory_order_acquire))
+        ;
+    std::vector<Site> out(sites, sites + used);
+    busy.clear(std::memory_order_release);
+
+    std::sort(out.begin(), out.end(), [](const Site & a, const Site & b) { return a.samples > b.samples; });
+    return out;
+}
+
+void Report(std::ostream & os, std::size_t top)
+{
+    const auto all = Sites();
+    for (std::size_t s=0; s<std::min(top, all.size()); ++s)
+    {
+        os << "  " << all[s].samples << " samples, " << all[s].bytes << " bytes\n";
+        for (auto f : all[s].frames)
+        {
+            if (!f)
+                break;
+
+            Dl_info info{};
+            int status = -1;
+            char * name = (dladdr(f, &info) && info.dli_sname) ? abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status) : nullptr;
+            os << "    " << f << " " << (name ? name : (info.dli_sname ? info.dli_sname : "?")) << "\n";
+            std::free(name);
+        }
+    }
+}
+
+}
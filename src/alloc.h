@@ -0,0 +1,41 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <iostream>
+
+// Opt-in heap allocation tracker. Linking src/alloc.cpp into a program replaces the global
+// operator new and delete; nothing is counted until Enable(). With sampling on, every Nth
+// allocation also records a short backtrace, so that the sites allocating the most can be told.
+//
+// Counters are process wide and safe to use from any thread.
+namespace Alloc
+{
+
+static constexpr std::size_t DEPTH = 8;         // Frames kept per sampled site
+static constexpr std::size_t SITES = 256;       // Distinct sites kept, later ones are only counted
+
+struct Site
+{
+    void * frames[DEPTH];
+    uint64_t samples;
+    uint64_t bytes;
+};
+
+// sample_every = 0 only counts
+void Enable(unsigned int sample_every = 0);
+void Disable();
+void Clear();
+
+uint64_t Allocations();
+uint64_t Bytes();
+uint64_t Frees();
+
+// Sampled sites, most samples first
+std::vector<Site> Sites();
+
+// Prints the `top` sites with the symbols of their frames, when known
+void Report(std::ostream & os, std::size_t top = 8);
+
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <memory>
+#include <limits>
+#include <cstdint>
+
+#include "state.h"
+
+// Type erased machine, for hosts that choose the machine or backend at run time or keep
+// different ones behind one pointer. The machines themselves are bound at compile time (see
+// Machine in machine.h); this puts a single virtual call in front of each operation, so it costs
+// the least when driven a frame at a time rather than an instruction at a time.
+class AnyMachine
+{
+public:
+    virtual ~AnyMachine() = default;
+
+    virtual bool LoadROM(const uint8_t * rom, std::size_t size) = 0;
+    virtual void Reset() = 0;
+    virtual void Task() = 0;
+    virtual void RunFrame(unsigned int ipf) = 0;
+    virtual void TickTimers() = 0;
+    virtual void SetLimit(uint64_t l) = 0;
+    virtual bool IsRunning() const = 0;
+    virtual bool Suspended() = 0;
+    virtual uint64_t GetRetired() const = 0;
+    virtual uint64_t GetDispatches() const = 0;
+    virtual void SaveState(CHIP8State & s) const = 0;
+    virtual void LoadState(const CHIP8State & s) = 0;
+};
+
+template <class tMachine>
+class AnyMachineOf : public AnyMachine
+{
+protected:
+    tMachine machine;
+
+public:
+    tMachine & Get() { return machine; };
+
+    virtual bool LoadROM(const uint8_t * rom, std::size_t size) { return machine.LoadROM(rom, size); };
+    virtual void Reset() { machine.Reset(); };
+    virtual void Task() { machine.Task(); };
+    virtual void RunFrame(unsigned int ipf) { machine.RunFrame(ipf); };
+    virtual void TickTimers() { machine.TickTimers(); };
+    virtual void SetLimit(uint64_t l) { machine.SetLimit(l); };
+    virtual bool IsRunning() const { return machine.IsRunning(); };
+    virtual bool Suspended() { return machine.Suspended(); };
+    virtual uint64_t GetRetired() const { return machine.GetRetired(); };
+    virtual uint64_t GetDispatches() const { return machine.GetDispatches(); };
+    virtual void SaveState(CHIP8State & s) const { machine.SaveState(s); };
+    virtual void LoadState(const CHIP8State & s) { machine.LoadState(s); };
+};
+
+template <class tMachine>
+std::shared_ptr<AnyMachine> MakeAnyMachine()
+{
+    return std::make_shared<AnyMachineOf<tMachine>>();
+}
@@ -0,0 +1,215 @@
+#pragma once
+
+#include <array>
+#include <limits>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+#include <cstring>
+#include <memory>
+#include <iostream>
+
+#include "machine.h"
+#include "headless.h"
+
+// Runtime for ROMs translated ahead of time by chip8-aot.
+//
+// Every translated basic block is a plain function working straight on the machine registers.
+// The dispatcher looks blocks up by PC; whatever has no block (computed jumps into unknown
+// addresses, code outside the ROM image, unsupported opcodes) runs on the interpreter.
+// Before running a block its bytes are checked against the ROM image it was translated from
+// whenever the write generation of its pages moved, so self-modifying code also falls back.
+// chip8-aot starts every instruction of a block in the page of its first one, so a block
+// touches two pages at most.
+template <class tBackend>
+class CHIP8AOT : public CHIP8Core<tBackend>
+{
+public:
+    typedef CHIP8Core<tBackend> Base;
+    typedef typename Base::MemorySpecs MemorySpecs;
+    typedef void (*BlockFn)(CHIP8AOT &);
+
+    struct Block
+    {
+        uint16_t addr;                          // First instruction
+        uint16_t size;                          // Bytes covered by the block
+        uint16_t count;                         // Instructions in the block, fewer if it leaves early
+        BlockFn fn;
+    };
+
+    // Translated code works on the registers directly
+    using Base::PC;
+    using Base::V;
+    using Base::I;
+    using Base::stack;
+    using Base::ram;
+    using Base::retired;
+
+protected:
+    const uint8_t * image;                      // ROM the blocks were translated from
+    std::size_t image_size;
+    std::array<const Block *, MemorySpecs::Size> blocks;
+    std::array<uint64_t, MemorySpecs::Size> seen;  // Page generations the block was last verified at
+
+    uint64_t blocks_run = 0;
+    uint64_t fallbacks = 0;
+
+    static uint64_t Generations(const MemorySpecs & mem, const Block & b)
+    {
+        return (uint64_t(mem.Generation(b.addr)) << 32) | mem.Generation(b.addr + b.size - 1);
+    }
+
+    bool Valid(const Block & b)
+    {
+        const auto gen = Generations(ram, b);
+        if (seen[b.addr] == gen)
+            return true;
+
+        const auto offset = b.addr - Base::MEMORY_USABLE;
+        for (auto i=0; i<b.size; ++i)
+            if (ram.Read(b.addr + i) != image[offset + i])
+                return false;
+
+        seen[b.addr] = gen;
+        return true;
+    }
+
+    const Block * LookupBlock()
+    {
+        if (PC >= blocks.size())
+            return nullptr;
+        auto b = blocks[PC];
+        return (b && Valid(*b)) ? b : nullptr;
+    }
+
+public:
+    CHIP8AOT(const uint8_t * rom, std::size_t rom_size, const Block * table, std::size_t table_size) : image{rom}, image_size{rom_size}, blocks{}
+    {
+        seen.fill(~uint64_t(0));
+        // Valid() only sees the first and last page of a block; anything longer stays interpreted
+        for (std::size_t i=0; i<table_size; ++i)
+            if (MemorySpecs::Page(table[i].addr + table[i].size - 1) <= MemorySpecs::Page(table[i].addr) + 1)
+                blocks[table[i].addr] = &table[i];
+        Base::LoadROM(rom, rom_size);
+    }
+
+    uint64_t GetBlocksRun() const { return blocks_run; };
+
+    // Runs the instruction at PC on the interpreter, for opcodes that need machine services
+    void Interpret() { Base::Task(); };
+    uint64_t GetFallbacks() const { return fallbacks; };
+
+    void Task()
+    {
+        if (!this->IsRunning())
+            return;
+
+        if (auto b = LookupBlock())
+        {
+            ++blocks_run;
+            b->fn(*this);
+            return;
+        }
+
+        ++fallbacks;
+        Base::Task();
+    }
+
+    // Same contract as CHIP8Core::RunFrame, but blocks never run past the frame budget so that
+    // translated and interpreted runs stay in lockstep. Blocks have no cycle cost to charge (it
+    // depends on the registers), so Timing::VIP frames run on the interpreter.
+    void RunFrame(unsigned int ipf)
+    {
+        if (this->GetTiming() == Base::Timing::VIP)
+        {
+            const auto before = retired;
+            Base::RunFrame(ipf);
+            fallbacks += retired - before;
+            return;
+        }
+
+        const auto target = retired + ipf;
+        this->limit = target;
+        while (retired < target && this->IsRunning() && !this->Suspended())
+        {
+            auto b = LookupBlock();
+            if (b && retired + b->count <= target)
+            {
+                ++blocks_run;
+                b->fn(*this);
+            }
+            else
+            {
+                ++fallbacks;
+                Base::Task();
+            }
+        }
+        this->limit = std::numeric_limits<uint64_t>::max();
+        this->suspended += (this->waiting != Base::Wait::None);
+        this->TickTimers();
+    }
+};
+
+// Entry point of the executables generated by chip8-aot: runs the ROM on the interpreter and
+// on the translated blocks for the same number of frames and reports both. Each side is timed
+// as the best of a few runs; the comparison only means something in an optimized build.
+template <class tBlock>
+int AOTMain(const uint8_t * rom, std::size_t rom_size, const tBlock * table, std::size_t table_size, int argc, char* argv[])
+{
+    typedef CHIP8AOT<HeadlessBackend> M;
+
+    unsigned int frames = 600;
+    unsigned int ipf = 1000;
+    unsigned int runs = 5;
+    for (auto i=1; i<argc - 1; ++i)
+    {
+        if (std::string(argv[i]) == "--frames")
+            frames = std::stoul(argv[++i]);
+        else if (std::string(argv[i]) == "--ipf")
+            ipf = std::stoul(argv[++i]);
+        else if (std::string(argv[i]) == "--runs")
+            runs = std::max(1ul, std::stoul(argv[++i]));
+    }
+    const bool vip = std::find(argv + 1, argv + argc, std::string("--vip")) != argv + argc;
+
+#ifndef __OPTIMIZE__
+    std::cout << "warning: unoptimized build, timings do not reflect either side\n";
+#endif
+
+    auto run = [&](const tBlock * t, std::size_t n, const char * name)
+    {
+        std::unique_ptr<M> m;
+        double best = std::numeric_limits<double>::max();
+        for (unsigned int r=0; r<runs; ++r)
+        {
+            m = std::make_unique<M>(rom, rom_size, t, n);
+            if (vip)
+                m->SetTiming(M::Timing::VIP);
+
+            auto start = std::chrono::steady_clock::now();
+            for (unsigned int f=0; f<frames && m->IsRunning(); ++f)
+                m->RunFrame(ipf);
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            best = std::min(best, elapsed.count());
+        }
+
+        std::cout << name << ": " << std::dec << m->GetRetired() << " instructions in " << best << "s = "
+                  << uint64_t(m->GetRetired() / best) << " IPS ("
+                  << m->GetBlocksRun() << " block dispatches, " << m->GetFallbacks() << " interpreted, "
+                  << m->GetSuspended() << " frames suspended)\n";
+        return std::make_pair(std::move(m), best);
+    };
+
+    auto interp = run(nullptr, 0, "interpreter");
+    auto aot = run(table, table_size, "aot        ");
+
+    // The counters are part of what a saved state restores, so they have to agree as well
+    const auto & a = *interp.first;
+    const auto & b = *aot.first;
+    const bool same = a.SameState(b) && a.GetRetired() == b.GetRetired() && a.GetSuspended() == b.GetSuspended();
+
+    std::cout << "speedup: " << interp.second / aot.second << "x\n";
+    std::cout << "final state " << (same ? "matches" : "DIFFERS") << "\n";
+
+    return same ? 0 : 1;
+}
@@ -1,63 +1,449 @@
 #include <memory>
+#include <random>
+#include <csignal>
+#include <ctime>
+#include <iomanip>
+#include <fstream>
 
 #include <SDL2/SDL.h>
 #include <config.h>
 
-#include "src/machine.h"
+#include "src/sdl.h"
+#include "src/render.h"
+#include "src/metrics.h"
+#include "src/libchip8.h"
+#include "src/video.h"
+#include "src/movie.h"
+#include "src/shm.h"
+#include "src/romindex.h"
+#include "src/runahead.h"
+#include "src/profiler.h"
+#include "src/tools/corpus.h"
 
-#ifdef DEBUG
-std::ostream &debug = std::cout;
-#else
-std::ofstream dev_null("/dev/null");
-std::ostream &debug = dev_null;
-#endif
+// SDL front end over libchip8: SDL provides the keys, the window and the beep, the library
+// runs the machine one 60hz frame at a time. Frames are scaled and filtered on a render thread
+// (see render.h), so drawing never slows the machine down; this thread, which owns the window,
+// only puts the result on it.
 
-int main(int argc, char* argv[]) {
+namespace
+{
 
-    if (argc < 2) {
-        std::cerr << "Please specify a ROM to load." << std::endl;
-        std::cerr << "EX:" << std::endl;
-        std::cerr << argv[0] << " [ROMFILE.ch8]" << std::endl;
-        std::cerr << std::endl;
-        return 0;
+// Set on SIGINT/SIGTERM, so that movies and captures still get written
+volatile std::sig_atomic_t quit = 0;
+
+struct Options
+{
+    std::string rom;
+    unsigned int ipf = 0;                       // 0 = from the ROM index, 12 if it is not there
+    bool vip = false;                           // COSMAC VIP timing instead of ipf
+    std::string index = "chip8.idx";            // Written by chip8-scan
+    std::string record;                         // Video capture to write, if any
+    std::string movie;                          // Input movie to record, if any
+    std::string share;                          // Shared memory segment to export to, if any
+    bool hud = false;                           // Metrics overlay
+    std::string stats;                          // Metrics file, Prometheus text or .json
+    unsigned int stats_interval = 10;           // Seconds between metrics file updates
+    unsigned int scale = 10;                    // Window pixels per CHIP-8 pixel
+    Filter::Options filter;
+    bool startup_profile = false;               // Print where startup time goes
+    unsigned int run_ahead = 0;                 // Frames presented ahead of the real one
+    std::string profile;                        // Host profile trace to write, if any
+};
+
+bool ParseFilter(const std::string & name, Filter::Kind & kind)
+{
+    if (name == "nearest")
+        kind = Filter::Kind::Nearest;
+    else if (name == "epx" || name == "scale2x")
+        kind = Filter::Kind::EPX;
+    else if (name == "scale3x")
+        kind = Filter::Kind::Scale3x;
+    else
+        return false;
+    return true;
+}
+
+// Key map file probed for a ROM, named after a hash of its bytes
+std::string KeymapFile(const std::vector<uint8_t> & rom)
+{
+    return RomIndex::Key(rom) + std::string(".kmap");
+}
+
+// CPU time of the calling thread
+std::chrono::nanoseconds ThreadTime()
+{
+    timespec ts{};
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return std::chrono::seconds(ts.tv_sec) + std::chrono::nanoseconds(ts.tv_nsec);
+}
+
+// Time from exec to the first instruction, step by step. Steps are marked whether or not the
+// profile is printed, it costs a clock read each.
+class StartupProfile
+{
+protected:
+    std::chrono::nanoseconds before_main{0};    // Process CPU time: loader and static constructors
+    std::chrono::steady_clock::time_point start, last;
+    std::vector<std::pair<const char *, std::chrono::steady_clock::duration>> steps;
+    bool done = false;
+
+public:
+    void Start()
+    {
+        timespec ts{};
+        clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+        before_main = std::chrono::seconds(ts.tv_sec) + std::chrono::nanoseconds(ts.tv_nsec);
+        start = last = std::chrono::steady_clock::now();
     }
 
-    SDL_Init(SDL_INIT_EVERYTHING);
+    void Mark(const char * step)
+    {
+        if (done)
+            return;
+        const auto now = std::chrono::steady_clock::now();
+        steps.emplace_back(step, now - last);
+        last = now;
+    }
+
+    // Ends the profile, printing it the first time only
+    void Print(std::ostream & os)
+    {
+        if (done)
+            return;
+        done = true;
+        auto ms = [](auto d) { return std::chrono::duration<double, std::milli>(d).count(); };
+        os << std::fixed << std::setprecision(3) << "Startup profile:\n";
+        os << "  " << std::left << std::setw(20) << "before main (cpu)" << std::right << std::setw(9) << ms(before_main) << "ms\n";
+        for (auto & [step, d] : steps)
+            os << "  " << std::left << std::setw(20) << step << std::right << std::setw(9) << ms(d) << "ms\n";
+        os << "  " << std::left << std::setw(20) << "main to first frame" << std::right << std::setw(9) << ms(last - start) << "ms\n";
+        os << std::defaultfloat;
+    }
+};
+
+StartupProfile startup;
 
-    auto m = std::shared_ptr<Machine<uint16_t, uint16_t>>(new CHIP8);
-    bool running = m->LoadROM(argv[1]);
+// Speed from the index entry of the ROM, if any, warning about what this machine cannot run
+unsigned int ConsultIndex(const std::string & path, const std::vector<uint8_t> & rom)
+{
+    RomIndex::Entry e;
+    if (!RomIndex::Find(path, RomIndex::Key(rom), e))
+        return 12;
 
+    std::cout << "Indexed as " << e.Platform() << ", quirks " << RomIndex::QuirkNames(e.quirks) << ", " << e.ipf * 60 << " instructions/s\n";
+    if (e.sets & (RomIndex::SET_SCHIP | RomIndex::SET_XOCHIP))
+        std::cout << "Warning: " << e.Platform() << " instructions are not supported, the ROM may not run\n";
+    if (e.quirks & RomIndex::QUIRK_SHIFT)
+        std::cout << "Warning: the ROM may expect shifts to read VY, this machine shifts VX in place\n";
+    return e.ipf;
+}
+
+int Run(Options opt)
+{
+    auto rom = ReadROM(opt.rom);
+    startup.Mark("rom read");
+    if (!opt.ipf && !opt.vip)
+        opt.ipf = ConsultIndex(opt.index, rom);
+    startup.Mark("rom index");
+
+    std::unique_ptr<chip8_t, decltype(&chip8_destroy)> m(chip8_create(), chip8_destroy);
+    if (!m)
+        return 1;
+    startup.Mark("machine create");
+
+    // Recorded sessions get a random seed, kept in the movie
+    Movie movie;
+    movie.seed = opt.movie.empty() ? 12345 : std::random_device{}();
+    movie.ipf = opt.vip ? 0 : opt.ipf;
+    movie.rom_hash = Movie::Hash(rom.data(), rom.size());
+
+    chip8_set_seed(m.get(), movie.seed);
+    chip8_set_timing(m.get(), opt.vip ? CHIP8_TIMING_VIP : CHIP8_TIMING_INSTRUCTIONS);
+    if (rom.empty() || chip8_load_rom_from_memory(m.get(), rom.data(), rom.size())) {
+        std::cerr << "Error loading ROM " << opt.rom << "\n";
+        return 1;
+    }
+    std::cout << "Loaded " << rom.size() << " bytes!\n";
+    startup.Mark("rom load");
+
+    Video::Recorder recorder(CHIP8_FRAMEBUFFER_WIDTH, CHIP8_FRAMEBUFFER_HEIGHT);
+    if (!opt.record.empty() && !recorder.Open(opt.record)) {
+        std::cerr << "Error opening capture " << opt.record << "\n";
+        return 1;
+    }
+
+    SharedMemory::Exporter share;
+    if (!opt.share.empty() && !share.Create(opt.share)) {
+        std::cerr << "Error creating shared memory " << opt.share << "\n";
+        return 1;
+    }
+
+    startup.Mark("capture and share");
+
+    DisplaySDL display(CHIP8_FRAMEBUFFER_WIDTH, CHIP8_FRAMEBUFFER_HEIGHT, opt.scale);
+    display.SetFilter(opt.filter);
+    startup.Mark("window");
+    InputSDL input;
+    TimerAudioSDL<uint8_t, 60> beep(600);
+    startup.Mark("input and timer");
+
+    const auto key_map_file = KeymapFile(rom);
+    std::cout << "Trying to load " << key_map_file << " as key map..." << std::endl;
+    input.LoadKeymap(key_map_file);
+    startup.Mark("key map");
+
+    Metrics::Counters metrics;
+    display.SetMetrics(&metrics, opt.hud);
+    beep.SetMetrics(&metrics);
+
+    std::unique_ptr<Metrics::File> stats_file;
+    if (!opt.stats.empty())
+        stats_file = std::make_unique<Metrics::File>(metrics, opt.stats, std::chrono::seconds(std::max(opt.stats_interval, 1u)));
+
+    Renderer<DisplaySDL> renderer(display, display.GetRefreshRate());
+    startup.Mark("metrics and renderer");
+
+    std::size_t video_size = 0;
+    const uint8_t * video = chip8_get_framebuffer(m.get(), &video_size);
+    chip8_registers_t regs;
+    RunAhead ahead(m.get(), opt.run_ahead);
+
+    auto start = SDL_GetTicks();
+    uint64_t frames = 0;
+    bool running = true;
+    Uint32 key_time = 0;                        // Oldest key press not seen by the machine yet
+    uint64_t key_wait_frames = 0;               // Spent by the guest blocked on fX0a
+    std::chrono::nanoseconds key_wait_cpu{0}, key_wait_time{0};
+    uint64_t shown_hash = 0;                    // Of the last presented frame
+    uint64_t photon_from = 0;                   // Presented frame when the measured press came
+    int photon_age = -1;                        // Frames since the measured press, -1 = none
+    uint64_t photon_presses = 0, photon_frames = 0, photon_max = 0;
     SDL_Event event;
-    while (running)
+    while (running && !quit && chip8_is_running(m.get()))
     {
-        SDL_ClearError();
-        if (SDL_WaitEventTimeout(&event, 1) == 0)
+        Profiler::Probe frame_probe(Profiler::Region::Frame);
+        const auto frame_cpu = ThreadTime();
+        const auto frame_start = std::chrono::steady_clock::now();
+        Metrics::Counters::Set(metrics.drift_us, (int64_t(SDL_GetTicks()) - int64_t(start + frames * 1000 / 60)) * 1000);
+
+        {
+            Profiler::Probe probe(Profiler::Region::Events);
+            while (SDL_PollEvent(&event))
+            {
+                if (event.type == SDL_QUIT)
+                    running = false;
+                if (event.type == SDL_KEYDOWN)
+                {
+                    if (!event.key.repeat && !key_time)
+                        key_time = std::max<Uint32>(event.key.timestamp, 1);
+
+                    if (event.key.keysym.scancode == SDL_GetScancodeFromName("Escape"))
+                        running = false;
+
+                    // A movie has no way to tell about resets
+                    if (event.key.keysym.scancode == SDL_GetScancodeFromName("F5") && opt.movie.empty())
+                        chip8_reset(m.get());
+                }
+            }
+        }
+
+        uint16_t keys = 0;
+        for (auto k=0; k<gInputTotalKeys; ++k)
+            keys |= uint16_t(input.IsPressed(Input::Key(k))) << k;
+        if (share.IsOpen())
+            keys |= share.PollKeys();
+
+        const auto emulation_start = std::chrono::steady_clock::now();
+        const uint8_t * shown = ahead.Step(keys, opt.ipf, regs);
+        Metrics::Counters::Add(metrics.emulation_ns, std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - emulation_start).count());
+        if (!frames && opt.startup_profile)
+        {
+            startup.Mark("first frame");
+            startup.Print(std::cout);
+        }
+
+        Metrics::Counters::Add(metrics.frames, 1);
+        Metrics::Counters::Set(metrics.instructions, regs.retired);
+        if (key_time)
+        {
+            Metrics::Counters::Add(metrics.inputs, 1);
+            Metrics::Counters::Add(metrics.input_latency_us, uint64_t(SDL_GetTicks() - key_time) * 1000);
+            key_time = 0;
+            if (photon_age < 0)
+            {
+                photon_age = 0;
+                photon_from = shown_hash;
+            }
+        }
+
+        // Input to photon: frames from the press to the first presented picture that differs.
+        // Presses that change nothing within a second are not counted.
+        shown_hash = Movie::Hash(shown, video_size);
+        if (photon_age >= 0)
         {
-            const char * err = SDL_GetError();
-            if (err[0]) {
-                std::cout << "Err:" << err << "\n";
-                break;
+            if (shown_hash != photon_from)
+            {
+                ++photon_presses;
+                photon_frames += photon_age;
+                photon_max = std::max<uint64_t>(photon_max, photon_age);
+                photon_age = -1;
             }
+            else if (++photon_age > 60)
+                photon_age = -1;
+        }
+
+        if (!opt.movie.empty())
+            movie.frames.push_back(Movie::Frame{ keys, Movie::Hash(video, video_size) });
+
+        if (share.IsOpen())
+        {
+            auto & f = share.Begin();
+            std::copy(video, video + video_size, f.video.begin());
+            std::copy(regs.V, regs.V + 16, f.V.begin());
+            f.I = regs.I;
+            f.PC = regs.PC;
+            f.delay = regs.delay;
+            f.sound = regs.sound;
+            f.keys = keys;
+            share.End();
         }
 
-        switch (event.type)
+        renderer.Submit(shown, shown + video_size);
+        beep.Set(regs.sound);
+        recorder.Capture(video);
+
+        // Pace to 60hz, starting over after a stall instead of running to catch up
+        const auto due = start + ++frames * 1000 / 60;
+        const auto now = SDL_GetTicks();
+        if (due > now)
+            SDL_Delay(due - now);
+        else if (now - due > 100)
         {
-        case SDL_QUIT:
-            running = false;
-            break;
-        case SDL_KEYDOWN:
-            if (event.key.keysym.scancode == SDL_GetScancodeFromName("Escape"))
-                running = false;
-            if (event.key.keysym.scancode == SDL_GetScancodeFromName("F5"))
-                m->Reset();
-            std::cout << "Umapped key pressed: " << SDL_GetScancodeName(event.key.keysym.scancode) << std::endl;
-            break;
+            start = now;
+            frames = 0;
         }
 
-        m->Task();
+        // After the delay, which gives the render thread time to get to the frame just submitted
+        renderer.Present();
+
+        if (chip8_get_wait(m.get()) == CHIP8_WAIT_KEY)
+        {
+            ++key_wait_frames;
+            key_wait_cpu += ThreadTime() - frame_cpu;
+            key_wait_time += std::chrono::steady_clock::now() - frame_start;
+        }
     }
 
-    SDL_Quit();
+    recorder.Close();
+
+    renderer.Stop();
+    const auto stats = renderer.GetStats();
+    std::cout << "Display: " << stats.rendered << " of " << stats.submitted << " frames rendered, " << stats.presented << " presented, "
+              << stats.dropped << " dropped, " << stats.duplicated << " duplicated refreshes, frame time avg="
+              << stats.draw_avg_ms << "ms max=" << stats.draw_max_ms << "ms, longest interval=" << stats.interval_max_ms << "ms\n";
+    if (photon_presses)
+        std::cout << "Input to photon: " << photon_presses << " presses, avg=" << double(photon_frames) / photon_presses
+                  << " max=" << photon_max << " frames after the frame that saw the press, run-ahead " << opt.run_ahead << " frames\n";
+    if (key_wait_frames)
+        std::cout << "Waiting for a key: " << key_wait_frames << " frames, host CPU "
+                  << 100.0 * key_wait_cpu.count() / std::max<int64_t>(key_wait_time.count(), 1) << "% of a core\n";
+
+    if (!opt.movie.empty())
+    {
+        if (!movie.Save(opt.movie)) {
+            std::cerr << "Error writing movie " << opt.movie << "\n";
+            return 1;
+        }
+        std::cout << "Recorded " << movie.frames.size() << " frames to " << opt.movie << "\n";
+    }
 
     return 0;
-}
\ No newline at end of file
+}
+
+}
+
+int main(int argc, char* argv[]) {
+
+    startup.Start();
+
+    Options opt;
+    for (auto i=1; i<argc; ++i)
+    {
+        const std::string arg{argv[i]};
+        if (arg == "--record" && i + 1 < argc)
+            opt.record = argv[++i];
+        else if (arg == "--movie" && i + 1 < argc)
+            opt.movie = argv[++i];
+        else if (arg == "--share" && i + 1 < argc)
+            opt.share = argv[++i];
+        else if (arg == "--ipf" && i + 1 < argc)
+            opt.ipf = std::stoul(argv[++i]);
+        else if (arg == "--vip")
+            opt.vip = true;
+        else if (arg == "--index" && i + 1 < argc)
+            opt.index = argv[++i];
+        else if (arg == "--scale" && i + 1 < argc)
+            opt.scale = std::clamp(std::stoul(argv[++i]), 1ul, 30ul);
+        else if (arg == "--filter" && i + 1 < argc && ParseFilter(argv[i + 1], opt.filter.kind))
+            ++i;
+        else if (arg == "--scanlines")
+            opt.filter.scanlines = true;
+        else if (arg == "--grid")
+            opt.filter.grid = true;
+        else if (arg == "--phosphor" && i + 1 < argc)
+            opt.filter.persistence = std::min(std::stoul(argv[++i]), 255ul);
+        else if (arg == "--hud")
+            opt.hud = true;
+        else if (arg == "--stats" && i + 1 < argc)
+            opt.stats = argv[++i];
+        else if (arg == "--stats-interval" && i + 1 < argc)
+            opt.stats_interval = std::stoul(argv[++i]);
+        else if (arg == "--run-ahead" && i + 1 < argc)
+            opt.run_ahead = std::min(std::stoul(argv[++i]), 8ul);
+        else if (arg == "--startup-profile")
+            opt.startup_profile = true;
+        else if (arg == "--profile" && i + 1 < argc)
+            opt.profile = argv[++i];
+        else
+            opt.rom = arg;
+    }
+
+    if (opt.rom.empty()) {
+        std::cerr << "Please specify a ROM to load." << std::endl;
+        std::cerr << "EX:" << std::endl;
+        std::cerr << argv[0] << " [--record CAPTURE.c8v] [--movie MOVIE.c8m] [--share /NAME] [--ipf N|--vip] [--index FILE] [--scale N]"
+                  << " [--filter nearest|epx|scale2x|scale3x] [--scanlines] [--grid] [--phosphor 0-255] [--hud] [--stats FILE[.json]] [--stats-interval S] [--run-ahead N] [--startup-profile] [--profile TRACE.json] [ROMFILE.ch8]" << std::endl;
+        std::cerr << std::endl;
+        return 0;
+    }
+
+    // Subsystems are brought up by the backends that use them (see sdl.h)
+    SDL_Init(0);
+    startup.Mark("sdl init");
+
+    std::signal(SIGINT, [](int) { quit = 1; });
+    std::signal(SIGTERM, [](int) { quit = 1; });
+
+    // Before the render and audio threads start, which only record while it is on
+    if (!opt.profile.empty())
+    {
+        Profiler::Enable(true);
+        Profiler::NameThread("main");
+    }
+
+    auto ret = Run(opt);
+
+    if (!opt.profile.empty())
+    {
+        Profiler::Dump(std::cout);
+        std::ofstream trace(opt.profile);
+        if (!Profiler::Trace(trace)) {
+            std::cerr << "Error writing profile " << opt.profile << "\n";
+            ret = 1;
+        }
+    }
+
+    SDL_Quit();
+
+    return ret;
+}
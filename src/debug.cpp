@@ -0,0 +1,11 @@
+#include <fstream>
+#include <iostream>
+
+#include <config.h>
+
+// One stream per thread: machines may run on several threads at once
+#ifdef DEBUG
+thread_local std::ostream debug(std::cout.rdbuf());
+#else
+thread_local std::ostream debug(nullptr);
+#endif
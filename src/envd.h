@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cstdint>
+#include <cerrno>
+#include <cstddef>
+
+#include <unistd.h>
+
+// Wire format of chip8-envd. Every message is a fixed header followed by `count` fixed size
+// records; all integers are little endian and there is no padding besides the explicit one.
+//
+//   RESET  request: count flags (uint8_t, non zero = reset that environment)
+//          reply:   count Observation
+//   STEP   request: count key masks (uint16_t), one per environment
+//          reply:   count Observation
+//   STATS  request: no records
+//          reply:   one Stats
+namespace Env
+{
+
+const uint32_t MAGIC = 0x56453843;              // "C8EV"
+
+enum Type : uint16_t
+{
+    RESET = 1,
+    STEP = 2,
+    STATS = 3
+};
+
+enum Status : uint16_t
+{
+    OK = 0,
+    BAD_REQUEST = 1
+};
+
+#pragma pack(push, 1)
+
+struct Header
+{
+    uint32_t magic;
+    uint16_t type;
+    uint16_t status;                            // Replies only
+    uint32_t count;
+};
+
+struct Observation
+{
+    uint8_t video[64 * 32 / 8];                 // 1 bit per pixel, MSB first, row major
+    int32_t reward;                             // Change of the score since the previous reply
+    uint8_t done;                               // Halted, over its frame budget or game over
+    uint8_t pad[3];
+};
+
+struct Stats
+{
+    uint64_t steps;                             // STEP requests served
+    uint64_t p50_ns;                            // Batch step latency percentiles, server side, within 12.5%
+    uint64_t p90_ns;
+    uint64_t p99_ns;
+    uint64_t max_ns;
+};
+
+#pragma pack(pop)
+
+static_assert(sizeof(Header) == 12 && sizeof(Observation) == 264 && sizeof(Stats) == 40, "Wire layout changed");
+
+// Blocking helpers for stream sockets. False on error or end of stream.
+inline bool ReadAll(int fd, void * buffer, std::size_t size)
+{
+    auto p = static_cast<uint8_t*>(buffer);
+    while (size)
+    {
+        const auto n = read(fd, p, size);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        p += n;
+        size -= n;
+    }
+    return true;
+}
+
+inline bool WriteAll(int fd, const void * buffer, std::size_t size)
+{
+    auto p = static_cast<const uint8_t*>(buffer);
+    while (size)
+    {
+        const auto n = write(fd, p, size);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        p += n;
+        size -= n;
+    }
+    return true;
+}
+
+}
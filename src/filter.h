@@ -0,0 +1,248 @@
+#pragma once
+
+#include <array>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+// CPU upscaling of the 1-bit framebuffer into 32-bit pixels, for the scaled display path.
+//
+// The pipeline works on 8-bit intensities, one row at a time:
+//   unpack bits -> phosphor persistence -> pixel art scaler (EPX/Scale2x, Scale3x)
+//   -> nearest neighbour to the output size -> palette -> scanlines and grid
+// Every stage is a straight loop over contiguous rows with no branches on pixel values, written
+// so that the compiler vectorizes it at -O2 (selects become blends, no gathers except the
+// palette), with no intrinsics to keep it portable.
+namespace Filter
+{
+
+enum class Kind
+{
+    Nearest,
+    EPX,                                        // Same as Scale2x
+    Scale3x
+};
+
+struct Options
+{
+    Kind kind = Kind::Nearest;
+    unsigned int scale = 10;                    // Output pixels per framebuffer pixel
+    bool scanlines = false;                     // Darken every other output row
+    bool grid = false;                          // Darken the last row and column of each pixel
+    uint8_t persistence = 0;                    // Phosphor: share of the last intensity kept per frame, out of 256
+    uint32_t on = 0xffffff;
+    uint32_t off = 0x000000;
+};
+
+class Upscaler
+{
+protected:
+    std::size_t w, h;
+    Options opt;
+    std::size_t k;                              // Pixel art factor: 1, 2 or 3
+    std::size_t hw, hh;                         // Size after the pixel art scaler
+    std::size_t ow, oh;                         // Output size
+
+    std::vector<uint8_t> padded;                // (w + 2) x (h + 2) intensities, edges replicated
+    std::vector<uint8_t> persist;               // w x h, phosphor state
+    std::vector<uint8_t> hires;                 // hw x hh
+    std::vector<uint32_t> xmap;                 // Output column -> hires column
+    std::vector<uint32_t> ymap;                 // Output row -> hires row
+    std::vector<uint32_t> cell_edge;            // Output column -> 0xffffffff on a grid line
+    std::vector<uint32_t> row;                  // hw colors
+    std::vector<uint32_t> line;                 // ow colors
+    std::vector<uint32_t> dark;                 // line darkened
+    std::array<uint32_t, 256> palette;
+
+    static uint32_t Darken(uint32_t c) { return (c >> 1) & 0x7f7f7f7f; };
+
+    uint8_t * Padded(std::size_t y) { return padded.data() + (y + 1) * (w + 2) + 1; };
+
+    void Unpack(const uint8_t * bits)
+    {
+        for (std::size_t y=0; y<h; ++y)
+        {
+            auto dst = Padded(y);
+            const auto src = bits + y * (w / 8);
+            for (std::size_t x=0; x<w; ++x)
+                dst[x] = uint8_t(0) - ((src[x / 8] >> (7 - x % 8)) & 0x1);
+        }
+    }
+
+    // Pixels fade instead of going dark at once, which hides the XOR redraw flicker
+    void Persist()
+    {
+        const uint16_t keep = opt.persistence;
+        for (std::size_t y=0; y<h; ++y)
+        {
+            auto p = Padded(y);
+            auto s = persist.data() + y * w;
+            for (std::size_t x=0; x<w; ++x)
+            {
+                const uint8_t faded = (s[x] * keep) >> 8;
+                s[x] = p[x] = std::max(p[x], faded);
+            }
+        }
+    }
+
+    void Edges()
+    {
+        for (std::size_t y=0; y<h; ++y)
+        {
+            auto p = Padded(y);
+            p[-1] = p[0];
+            p[w] = p[w - 1];
+        }
+        std::memcpy(Padded(0) - 1 - (w + 2), Padded(0) - 1, w + 2);
+        std::memcpy(Padded(h - 1) - 1 + (w + 2), Padded(h - 1) - 1, w + 2);
+    }
+
+    void Copy()
+    {
+        for (std::size_t y=0; y<h; ++y)
+            std::memcpy(hires.data() + y * hw, Padded(y), w);
+    }
+
+    //  B       E0 E1
+    // D E F -> E2 E3
+    //  H
+    void EPX()
+    {
+        for (std::size_t y=0; y<h; ++y)
+        {
+            const uint8_t * e = Padded(y);
+            const uint8_t * b = e - (w + 2);
+            const uint8_t * d = e + (w + 2);
+            uint8_t * o0 = hires.data() + 2 * y * hw;
+            uint8_t * o1 = o0 + hw;
+            for (std::size_t x=0; x<w; ++x)
+            {
+                const uint8_t B = b[x], D = e[x - 1], E = e[x], F = e[x + 1], H = d[x];
+                const bool edge = B != H && D != F;
+                o0[2 * x]     = (edge && D == B) ? D : E;
+                o0[2 * x + 1] = (edge && B == F) ? F : E;
+                o1[2 * x]     = (edge && D == H) ? D : E;
+                o1[2 * x + 1] = (edge && H == F) ? F : E;
+            }
+        }
+    }
+
+    // A B C       E0 E1 E2
+    // D E F  ->   E3 E4 E5
+    // G H I       E6 E7 E8
+    void Scale3x()
+    {
+        for (std::size_t y=0; y<h; ++y)
+        {
+            const uint8_t * e = Padded(y);
+            const uint8_t * b = e - (w + 2);
+            const uint8_t * d = e + (w + 2);
+            uint8_t * o0 = hires.data() + 3 * y * hw;
+            uint8_t * o1 = o0 + hw;
+            uint8_t * o2 = o1 + hw;
+            for (std::size_t x=0; x<w; ++x)
+            {
+                const uint8_t A = b[x - 1], B = b[x], C = b[x + 1];
+                const uint8_t D = e[x - 1], E = e[x], F = e[x + 1];
+                const uint8_t G = d[x - 1], H = d[x], I = d[x + 1];
+                const bool edge = B != H && D != F;
+                const bool db = edge && D == B, bf = edge && B == F, dh = edge && D == H, hf = edge && H == F;
+
+                o0[3 * x]     = db ? D : E;
+                o0[3 * x + 1] = ((db && E != C) || (bf && E != A)) ? B : E;
+                o0[3 * x + 2] = bf ? F : E;
+                o1[3 * x]     = ((db && E != G) || (dh && E != A)) ? D : E;
+                o1[3 * x + 1] = E;
+                o1[3 * x + 2] = ((bf && E != I) || (hf && E != C)) ? F : E;
+                o2[3 * x]     = dh ? D : E;
+                o2[3 * x + 1] = ((dh && E != I) || (hf && E != G)) ? H : E;
+                o2[3 * x + 2] = hf ? F : E;
+            }
+        }
+    }
+
+public:
+    Upscaler(std::size_t width, std::size_t height, const Options & o) : w{width}, h{height}, opt{o}
+    {
+        opt.scale = std::max(opt.scale, 1u);
+        k = opt.kind == Kind::Scale3x ? 3 : opt.kind == Kind::EPX ? 2 : 1;
+        k = std::min<std::size_t>(k, opt.scale);
+        hw = w * k;
+        hh = h * k;
+        ow = w * opt.scale;
+        oh = h * opt.scale;
+
+        padded.assign((w + 2) * (h + 2), 0);
+        persist.assign(w * h, 0);
+        hires.assign(hw * hh, 0);
+        row.resize(hw);
+        line.resize(ow);
+        dark.resize(ow);
+
+        xmap.resize(ow);
+        cell_edge.resize(ow);
+        for (std::size_t x=0; x<ow; ++x)
+        {
+            xmap[x] = x * hw / ow;
+            cell_edge[x] = (opt.grid && x % opt.scale == opt.scale - 1) ? 0xffffffff : 0;
+        }
+        ymap.resize(oh);
+        for (std::size_t y=0; y<oh; ++y)
+            ymap[y] = y * hh / oh;
+
+        for (unsigned int i=0; i<256; ++i)
+        {
+            uint32_t c = 0;
+            for (unsigned int shift=0; shift<24; shift += 8)
+            {
+                const uint32_t a = (opt.off >> shift) & 0xff, b = (opt.on >> shift) & 0xff;
+                c |= ((a * (255 - i) + b * i) / 255) << shift;
+            }
+            palette[i] = c;
+        }
+    }
+
+    std::size_t GetOutW() const { return ow; };
+    std::size_t GetOutH() const { return oh; };
+
+    // bits: w x h, 1 bit per pixel, MSB first. out: GetOutW() x GetOutH(), `pitch` pixels per row.
+    void Process(const uint8_t * bits, uint32_t * out, std::size_t pitch)
+    {
+        Unpack(bits);
+        if (opt.persistence)
+            Persist();
+        Edges();
+
+        if (k == 3)
+            Scale3x();
+        else if (k == 2)
+            EPX();
+        else
+            Copy();
+
+        std::size_t current = hh;
+        for (std::size_t y=0; y<oh; ++y)
+        {
+            if (ymap[y] != current)
+            {
+                current = ymap[y];
+                const auto src = hires.data() + current * hw;
+                for (std::size_t x=0; x<hw; ++x)
+                    row[x] = palette[src[x]];
+                for (std::size_t x=0; x<ow; ++x)
+                {
+                    const auto c = row[xmap[x]];
+                    line[x] = (c & ~cell_edge[x]) | (Darken(c) & cell_edge[x]);
+                }
+                for (std::size_t x=0; x<ow; ++x)
+                    dark[x] = Darken(line[x]);
+            }
+
+            const bool dim = (opt.scanlines && (y & 0x1)) || (opt.grid && y % opt.scale == opt.scale - 1);
+            std::memcpy(out + y * pitch, dim ? dark.data() : line.data(), ow * sizeof(uint32_t));
+        }
+    }
+};
+
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+// Position/value hashing shared by the incremental machine hash and the full recompute.
+// A state hash is the XOR of one term per position, so replacing a value is two XORs.
+namespace StateHash
+{
+
+// Position keys for everything that is not RAM (RAM uses the address)
+enum : uint64_t
+{
+    KEY_V = 0x10000,                            // + register index
+    KEY_I = 0x10100,
+    KEY_PC = 0x10101,
+    KEY_DELAY = 0x10102,
+    KEY_SOUND = 0x10103,
+    KEY_DISP_WAIT = 0x10104,
+    KEY_RNG = 0x10105,                          // Only in CHIP8Core::ExecutionHash
+    KEY_WAIT = 0x10106,
+    KEY_STACK = 0x20000                         // + depth
+};
+
+// splitmix64 finalizer
+inline uint64_t Mix(uint64_t x)
+{
+    x += 0x9e3779b97f4a7c15ull;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
+
+inline uint64_t Byte(uint64_t addr, uint8_t value) { return Mix((addr << 8) | value); };
+inline uint64_t Word(uint64_t key, uint64_t value) { return Mix(Mix(key) ^ value); };
+
+// Order dependent hash of a buffer (ROM images, framebuffers)
+inline uint64_t Buffer(const uint8_t * p, std::size_t size)
+{
+    uint64_t h = Mix(size);
+    for (std::size_t i=0; i<size; ++i)
+        h = Mix(h ^ p[i]);
+    return h;
+}
+
+// Faster order dependent hash, 8 bytes at a time; size must be a multiple of 8 (memory pages)
+inline uint64_t Block(const uint8_t * p, std::size_t size)
+{
+    uint64_t h = Mix(size);
+    for (std::size_t i=0; i<size; i += 8)
+    {
+        uint64_t w;
+        std::memcpy(&w, p + i, sizeof(w));
+        h = Mix(h ^ w);
+    }
+    return h;
+}
+
+}
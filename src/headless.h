@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "timer.h"
+#include "input.h"
+#include "display.h"
+
+// Backends with no host side effects, for tools and batch runs.
+// Nothing ticks the timers: whoever drives the machine calls TickTimers() once per frame.
+
+template<typename T, uint16_t HZ = 60, std::enable_if_t<std::is_integral<T>::value, bool> = true>
+class TimerAudioNull : public Timer<T, HZ>
+{
+public:
+    TimerAudioNull(uint16_t tone=440, uint32_t frequency=22000) { };
+};
+
+class InputHeadless : public Input
+{
+protected:
+    uint16_t keys;                              // Bit N set = key N pressed
+
+public:
+    InputHeadless() : keys{0} { };
+
+    void SetKeys(uint16_t mask) { keys = mask; };
+    uint16_t GetKeys() const { return keys; };
+
+    bool IsPressed(Key k) const
+    {
+        return (k != Key::_invalid) && ((keys >> (int(k) & 0xf)) & 0x1);
+    }
+
+    Key GetKey() const
+    {
+        for (auto i=0; i<gInputTotalKeys; ++i)
+            if ((keys >> i) & 0x1)
+                return Key(i);
+        return Key::_invalid;
+    }
+
+    bool LoadKeymap(const std::string & file) { return false; };
+};
+
+class DisplayNull : public Display<DisplayNull>
+{
+protected:
+    friend class Display<DisplayNull>;
+
+    void DrawPixel(uint16_t x, uint16_t y, uint32_t color) { };
+    void Present() { };
+
+public:
+    DisplayNull(uint16_t w, uint16_t h, uint16_t s) : Display(w, h, s) { };
+};
+
+struct HeadlessBackend
+{
+    typedef Timer<uint8_t, 60> TimerType;
+    typedef TimerAudioNull<uint8_t, 60> AudioType;
+    typedef InputHeadless InputType;
+    typedef DisplayNull DisplayType;
+};
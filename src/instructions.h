@@ -1,7 +1,10 @@
 #pragma once
 
-#include <cstdint>
+#include <array>
 #include <bitset>
+#include <cstdint>
+#include <limits>
+#include <algorithm>
 
 #include <thread>
 #include <chrono>
@@ -13,12 +16,10 @@
 namespace Instructions
 {
 
-template <class IT>
-void ClearDisplay(IT video_ram, uint8_t _W, uint8_t _H)
+template <class MEM>
+void ClearDisplay(MEM & ram, uint64_t video_ram, uint8_t _W, uint8_t _H)
 {
-    auto end = video_ram;
-    std::advance(end, (_W*_H) / 8);
-    std::fill(video_ram, end, 0x0);
+    ram.Fill(video_ram, (_W*_H) / 8, 0x0);
 }
 
 void Jump(Register<uint64_t> * PC, uint64_t addr);
@@ -131,35 +132,31 @@ void LShiftV(Register<T1> * to, uint8_t from, Register<T2> * overflow)
         *overflow = !!mask;
 }
 
-template <class IT, typename T1, typename T2, unsigned int N>
-void Store(IT ram, const Register<uint16_t> & _I, T1 _X, std::array<Register<T2>, N> * _V)
+template <class MEM, typename T1, typename T2, unsigned int N>
+void Store(MEM & ram, const Register<uint16_t> & _I, T1 _X, std::array<Register<T2>, N> * _V)
 {
-    ram += _I;
-    auto end = _V->begin() + _X + 1;
+    auto end = _V->begin() + std::min<unsigned int>(_X + 1, N);
 
-    std::copy(_V->begin(), end, ram);
+    ram.CopyIn(_I, _V->begin(), end);
 }
 
-template <class IT, typename T1, typename T2, unsigned int N>
-void Fill(IT ram, const Register<uint16_t> & _I, T1 _X, std::array<Register<T2>, N> * _V)
+template <class MEM, typename T1, typename T2, unsigned int N>
+void Fill(MEM & ram, const Register<uint16_t> & _I, T1 _X, std::array<Register<T2>, N> * _V)
 {
-    ram += _I;
-    auto end = ram + _X + 1;
-
-    std::copy(ram, end, _V->begin());
+    ram.CopyOut(_I, std::min<unsigned int>(_X + 1, N), _V->begin());
 }
 
-template <class IT>
-void BCD(IT ram, uint8_t _N, const Register<uint16_t> & _I)
+template <class MEM>
+void BCD(MEM & ram, uint8_t _N, const Register<uint16_t> & _I)
 {
     for (int8_t i=2; i>=0; --i) {
-        *(ram + _I + i) = _N % 10;
+        ram.Write(_I + i, _N % 10);
         _N /= 10;
     }
 }
 
-template <class IT, typename T1>
-void Draw(IT ram, IT video_ram, Register<T1> & _VF, Register<uint8_t> & _X, Register<uint8_t> & _Y, Register<uint16_t> & _I, uint8_t _N, uint8_t _W, uint8_t _H)
+template <class MEM, typename T1>
+void Draw(MEM & ram, uint64_t video_ram, Register<T1> & _VF, Register<uint8_t> & _X, Register<uint8_t> & _Y, Register<uint16_t> & _I, uint8_t _N, uint8_t _W, uint8_t _H)
 {
     // Draws a sprite at coordinate (VX, VY) that has a width of 8 pixels and a height of N pixels.
     // Each row of 8 pixels is read as bit-coded starting from memory location I; I value does not
@@ -171,23 +168,23 @@ void Draw(IT ram, IT video_ram, Register<T1> & _VF, Register<uint8_t> & _X, Regi
     uint8_t X = ((uint8_t)_X) % _W;
     uint8_t Y = ((uint8_t)_Y) % _H;
 
-    // Sets ram to the address of the first sprite
-    ram += _I;
+    // Address of the first sprite
+    uint64_t sprite = _I;
 
-    debug << "-- Y is " << +Y << " and X is " << +X << " --" << std::endl;
+    if (debug) debug << "-- Y is " << +Y << " and X is " << +X << " --" << std::endl;
 
     // Sets video_ram to the address of the first pixel
     video_ram += (Y * _W + X) / 8;
 
     while (_N-- && Y++ < _H)
     {
-        debug << "-- DRAWING LINE " << +(Y-1) << "--" << std::endl;
-        debug << "video_ram.........: " << std::bitset<8>(*video_ram) << std::bitset<8>(*(video_ram+1)) << std::endl;
+        if (debug) debug << "-- DRAWING LINE " << +(Y-1) << "--" << std::endl;
+        if (debug) debug << "video_ram.........: " << std::bitset<8>(ram.Read(video_ram)) << std::bitset<8>(ram.Read(video_ram+1)) << std::endl;
 
         // Get screen current pixels data
-        uint8_t screen_data = *video_ram << (X % 8);
+        uint8_t screen_data = ram.Read(video_ram) << (X % 8);
         if (X % 8)
-            screen_data |= *(video_ram+1) >> (8 - (X % 8));
+            screen_data |= ram.Read(video_ram+1) >> (8 - (X % 8));
 
         std::string prefix{};
         if ((X % 8))
@@ -198,13 +195,13 @@ void Draw(IT ram, IT video_ram, Register<T1> & _VF, Register<uint8_t> & _X, Regi
             for (auto i=0; i<(8-(X%8)); ++i)
                 sufix.push_back('-');
 
-        debug << "sprite (ram)......: " << prefix << std::bitset<8>(*ram) << sufix << std::endl;
-        debug << "screen_data.......: " << prefix << std::bitset<8>(screen_data) << sufix << std::endl;
+        if (debug) debug << "sprite (ram)......: " << prefix << std::bitset<8>(ram.Read(sprite)) << sufix << std::endl;
+        if (debug) debug << "screen_data.......: " << prefix << std::bitset<8>(screen_data) << sufix << std::endl;
 
         // XOR between screen_data and the sprite in ram
-        uint8_t screen_data_xored = screen_data ^ *ram;        
+        uint8_t screen_data_xored = screen_data ^ ram.Read(sprite);        
 
-        debug << "screen_data_xored.: " << prefix << std::bitset<8>(screen_data_xored) << sufix << std::endl;
+        if (debug) debug << "screen_data_xored.: " << prefix << std::bitset<8>(screen_data_xored) << sufix << std::endl;
 
         // If sprite goes beyond screen width, clip it
         uint8_t screen_data_mask = 0xff;
@@ -213,28 +210,25 @@ void Draw(IT ram, IT video_ram, Register<T1> & _VF, Register<uint8_t> & _X, Regi
         screen_data &= screen_data_mask;
         screen_data_xored &= screen_data_mask;
 
-        debug << "-- CLIPPING --" << std::endl;
-        debug << "screen_data.......: " << prefix << std::bitset<8>(screen_data) << sufix << std::endl;
-        debug << "screen_data_xored.: " << prefix << std::bitset<8>(screen_data_xored) << sufix << std::endl;
+        if (debug) debug << "-- CLIPPING --" << std::endl;
+        if (debug) debug << "screen_data.......: " << prefix << std::bitset<8>(screen_data) << sufix << std::endl;
+        if (debug) debug << "screen_data_xored.: " << prefix << std::bitset<8>(screen_data_xored) << sufix << std::endl;
 
         // Test if any bit flipped to 0
         _VF = !!((screen_data & screen_data_xored) != screen_data);
 
-        debug << "VF (COLLISION): " << _VF.print_dec() << std::endl;
+        if (debug) debug << "VF (COLLISION): " << _VF.print_dec() << std::endl;
 
         // Clear video_ram area and then writes the XORed data
-        *video_ram &= ~(screen_data_mask >> (X % 8));
-        *video_ram |= screen_data_xored >> (X % 8);
-        if (X % 8) {
-            *(video_ram + 1) &= ~(screen_data_mask << (8 - (X % 8)));
-            *(video_ram + 1) |= screen_data_xored << (8 - (X % 8));
-        }
-
-        debug << "-- AFTER DRAWING --" << std::endl;
-        debug << "video_ram.........: " << std::bitset<8>(*video_ram) << std::bitset<8>(*(video_ram+1)) << std::endl;
-
-        // Increment ram to get the next sprite
-        ram += 1;
+        ram.Write(video_ram, (ram.Read(video_ram) & ~(screen_data_mask >> (X % 8))) | (screen_data_xored >> (X % 8)));
+        if (X % 8)
+            ram.Write(video_ram + 1, (ram.Read(video_ram + 1) & ~(screen_data_mask << (8 - (X % 8)))) | (screen_data_xored << (8 - (X % 8))));
+
+        if (debug) debug << "-- AFTER DRAWING --" << std::endl;
+        if (debug) debug << "video_ram.........: " << std::bitset<8>(ram.Read(video_ram)) << std::bitset<8>(ram.Read(video_ram+1)) << std::endl;
+
+        // Increment sprite to get the next line of the sprite
+        sprite += 1;
         // Increment video_ram to get to the next line
         video_ram += (_W / 8);
     }
@@ -0,0 +1,164 @@
+#include <new>
+#include <limits>
+
+#include "libchip8.h"
+#include "machine.h"
+#include "headless.h"
+#include "state.h"
+
+typedef CHIP8Core<HeadlessBackend> Core;
+
+struct chip8
+{
+    Core core;
+    CHIP8State boot;                            // Right after construction: fonts, nothing else
+    mutable CHIP8State scratch;
+
+    chip8()
+    {
+        core.SaveState(boot);
+    }
+};
+
+extern "C" {
+
+chip8_t * chip8_create(void)
+{
+    try
+    {
+        return new chip8;
+    }
+    catch (...)
+    {
+        return nullptr;
+    }
+}
+
+void chip8_destroy(chip8_t * m)
+{
+    delete m;
+}
+
+int chip8_load_rom_from_memory(chip8_t * m, const uint8_t * rom, size_t size)
+{
+    if (size > m->core.GetRamSize())
+        return -1;
+
+    m->core.LoadState(m->boot);
+    m->core.Reset();
+    m->core.LoadROM(rom, size);
+    m->core.SetBaseline();
+    return 0;
+}
+
+void chip8_set_seed(chip8_t * m, uint32_t seed)
+{
+    m->core.SetSeed(seed);
+}
+
+void chip8_reset(chip8_t * m)
+{
+    m->core.ResetToBaseline();
+}
+
+uint64_t chip8_step_instructions(chip8_t * m, uint64_t n)
+{
+    auto & core = m->core;
+    const auto start = core.GetRetired();
+    const auto target = start + n;
+
+    core.SetLimit(target);
+    while (core.GetRetired() < target && core.IsRunning() && !core.Suspended())
+        core.Task();
+    core.SetLimit(std::numeric_limits<uint64_t>::max());
+
+    return core.GetRetired() - start;
+}
+
+uint64_t chip8_step_frames(chip8_t * m, uint32_t n, uint32_t ipf)
+{
+    auto & core = m->core;
+    const auto start = core.GetRetired();
+    for (uint32_t f=0; f<n && core.IsRunning(); ++f)
+        core.RunFrame(ipf);
+    return core.GetRetired() - start;
+}
+
+void chip8_set_timing(chip8_t * m, int timing)
+{
+    m->core.SetTiming(timing == CHIP8_TIMING_VIP ? Core::Timing::VIP : Core::Timing::Instructions);
+}
+
+int chip8_is_running(const chip8_t * m)
+{
+    return m->core.IsRunning();
+}
+
+int chip8_get_wait(const chip8_t * m)
+{
+    switch (m->core.GetWait())
+    {
+    case Core::Wait::Display: return CHIP8_WAIT_DISPLAY;
+    case Core::Wait::Key: return CHIP8_WAIT_KEY;
+    default: return CHIP8_WAIT_NONE;
+    }
+}
+
+void chip8_set_keys(chip8_t * m, uint16_t mask)
+{
+    m->core.GetInput().SetKeys(mask);
+}
+
+const uint8_t * chip8_get_framebuffer(const chip8_t * m, size_t * size)
+{
+    auto & ram = m->core.GetRam();
+    if (size)
+        *size = ram.end() - (ram.begin() + Core::MEMORY_VIDEO);
+    return ram.begin() + Core::MEMORY_VIDEO;
+}
+
+const uint8_t * chip8_get_ram(const chip8_t * m, size_t * size)
+{
+    auto & ram = m->core.GetRam();
+    if (size)
+        *size = ram.size();
+    return ram.begin();
+}
+
+void chip8_get_registers(const chip8_t * m, chip8_registers_t * regs)
+{
+    auto & core = m->core;
+    for (std::size_t x=0; x<16; ++x)
+        regs->V[x] = core.GetV(x);
+    regs->I = core.GetI();
+    regs->PC = core.GetPC();
+    regs->delay = core.GetDelayTimer();
+    regs->sound = core.GetSoundTimer();
+    regs->retired = core.GetRetired();
+    regs->suspended = core.GetSuspended();
+}
+
+size_t chip8_save_state(const chip8_t * m, uint8_t * buffer, size_t size)
+{
+    m->core.SaveState(m->scratch);
+    const auto needed = m->scratch.SerializedSize();
+    if (buffer && size >= needed)
+        m->scratch.Serialize(buffer);
+    return needed;
+}
+
+int chip8_load_state(chip8_t * m, const uint8_t * buffer, size_t size)
+{
+    if (!buffer || !m->scratch.Deserialize(buffer, size))
+        return -1;
+
+    m->core.LoadState(m->scratch);
+    return 0;
+}
+
+void chip8_restore_counters(chip8_t * m, const chip8_registers_t * regs)
+{
+    m->core.SetCounters(regs->retired, regs->suspended);
+}
+
+}
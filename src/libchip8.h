@@ -0,0 +1,110 @@
+#ifndef LIBCHIP8_H
+#define LIBCHIP8_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * libchip8: the emulation core as a library, with no SDL and no global state. Every machine is
+ * independent; a machine may be used from any thread, but only from one at a time.
+ *
+ * The machine is frame locked: nothing advances unless a step function is called, and the
+ * timers tick once per stepped frame.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct chip8 chip8_t;
+
+typedef struct chip8_registers
+{
+    uint8_t V[16];
+    uint16_t I;
+    uint16_t PC;
+    uint8_t delay;
+    uint8_t sound;
+    uint64_t retired;       /* Instructions executed since creation */
+    uint64_t suspended;     /* Frames that ended waiting on dXYN or fX0a, see chip8_get_wait */
+} chip8_registers_t;
+
+#define CHIP8_FRAMEBUFFER_WIDTH 64
+#define CHIP8_FRAMEBUFFER_HEIGHT 32
+
+/* NULL on allocation failure */
+chip8_t * chip8_create(void);
+void chip8_destroy(chip8_t * m);
+
+/* Returns 0 on success, -1 if the ROM does not fit. The ROM becomes what chip8_reset restores. */
+int chip8_load_rom_from_memory(chip8_t * m, const uint8_t * rom, size_t size);
+
+/* Seed of the CXNN random generator, applied on the next chip8_reset or ROM load */
+void chip8_set_seed(chip8_t * m, uint32_t seed);
+
+/* Back to the state right after the last ROM load */
+void chip8_reset(chip8_t * m);
+
+/*
+ * Run a number of instructions (the timers do not tick), or a number of frames of `ipf`
+ * instructions each, ticking the timers after every frame. Both return the number of
+ * instructions executed, which is short if the machine halted (see chip8_is_running) or, for
+ * chip8_step_instructions, got suspended (see chip8_get_wait).
+ */
+uint64_t chip8_step_instructions(chip8_t * m, uint64_t n);
+uint64_t chip8_step_frames(chip8_t * m, uint32_t n, uint32_t ipf);
+
+/*
+ * Pacing of chip8_step_frames. CHIP8_TIMING_INSTRUCTIONS, the default, runs `ipf` instructions
+ * a frame. CHIP8_TIMING_VIP ignores `ipf` and runs what the COSMAC VIP interpreter would in a
+ * frame, from the machine cycles of every instruction; sprites then wait for the vertical blank.
+ */
+#define CHIP8_TIMING_INSTRUCTIONS 0
+#define CHIP8_TIMING_VIP 1
+
+void chip8_set_timing(chip8_t * m, int timing);
+
+int chip8_is_running(const chip8_t * m);
+
+/*
+ * What the machine is suspended on, if anything. A blocked dXYN waits for the next frame, a
+ * blocked fX0a for a key; stepping a suspended machine retires its budget without host work.
+ */
+#define CHIP8_WAIT_NONE 0
+#define CHIP8_WAIT_DISPLAY 1
+#define CHIP8_WAIT_KEY 2
+
+int chip8_get_wait(const chip8_t * m);
+
+/* Bit N set = key N pressed, until the next call */
+void chip8_set_keys(chip8_t * m, uint16_t mask);
+
+/*
+ * Pointer into the machine video RAM: 64x32 pixels, 1 bit per pixel, MSB first, row major.
+ * It stays valid for the life of the machine and always shows the current frame.
+ */
+const uint8_t * chip8_get_framebuffer(const chip8_t * m, size_t * size);
+
+void chip8_get_registers(const chip8_t * m, chip8_registers_t * regs);
+
+/* Read only view of the whole 4 KiB address space, e.g. to read a score. Valid like the framebuffer. */
+const uint8_t * chip8_get_ram(const chip8_t * m, size_t * size);
+
+/*
+ * Serialized machine state. chip8_save_state returns the size of the state; it only writes it
+ * when `size` is large enough. chip8_load_state returns 0 on success, -1 on a malformed state.
+ */
+size_t chip8_save_state(const chip8_t * m, uint8_t * buffer, size_t size);
+int chip8_load_state(chip8_t * m, const uint8_t * buffer, size_t size);
+
+/*
+ * The retired and suspended counters are statistics, not state, so chip8_load_state leaves them
+ * alone. This sets them back to the ones in `regs`, for hosts that roll back frames they ran.
+ */
+void chip8_restore_counters(chip8_t * m, const chip8_registers_t * regs);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -1,7 +1,9 @@
 #include <iostream>
 #include <memory>
+#include <iomanip>
 
 #include "machine.h"
+#include "headless.h"
 
 unsigned int StrCmp(const std::string & s1, const std::string & s2)
 {
@@ -15,7 +17,8 @@ unsigned int StrCmp(const std::string & s1, const std::string & s2)
     return grade;
 }
 
-bool CHIP8::LoadROM(std::ifstream & is)
+template <class tBackend>
+bool CHIP8Core<tBackend>::LoadROM(std::ifstream & is)
 {
     uint32_t count = 0;
 
@@ -26,16 +29,17 @@ bool CHIP8::LoadROM(std::ifstream & is)
     for (auto i=0; i<GetRamSize() && is; ++i)
     {
         is.read(&byte, 1);
-        ram[MEMORY_USABLE + i] = byte;
+        ram.Write(MEMORY_USABLE + i, byte);
         ++count;
     }
 
     std::cout << "Loaded " << count << " bytes!\n";
+    Predecode(count);
 
     std::size_t result = 0;
     std::hash<uint8_t> hasher;
     for (auto i=MEMORY_USABLE; i<(MEMORY_USABLE + count); ++i)
-        result = result * 31 + ram[i];
+        result = result * 31 + ram.Read(i);
 
     std::string key_map_file{std::to_string(result)};
     while (key_map_file.length() > 8)
@@ -48,6 +52,10 @@ bool CHIP8::LoadROM(std::ifstream & is)
     return true;
 }
 
+template class CHIP8Core<HeadlessBackend>;
+
+constinit const std::array<uint8_t, 0x2000> CHIP8Decoder::TABLE = CHIP8Decoder::Build();
+
 std::ostream& operator<<(std::ostream& os, const struct CHIP8OpParse& Op)
 {
     os << "[" << std::hex << std::setw(4) << std::setfill('0') << Op.op << "]";
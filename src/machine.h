@@ -1,11 +1,12 @@
 #pragma once
 
 #include <array>
-#include <stack>
+#include <cstdio>
 #include <cstdlib>
 #include <cstdint>
 #include <fstream>
 #include <sstream>
+#include <iomanip>
 #include <optional>
 #include <iterator>
 #include <functional>
@@ -16,14 +17,28 @@
 
 #include "config.h"
 #include "register.h"
+#include "memory.h"
+#include "stack.h"
 #include "timer.h"
 #include "input.h"
 #include "display.h"
 #include "instructions.h"
+#include "state.h"
+#include "vip.h"
+#include "profiler.h"
 
 unsigned int StrCmp(const std::string & s1, const std::string & s2);
 
-template <typename tOp, typename tIns>
+// Generic fetch-decode-execute machine. tDerived is the concrete machine, bound at compile time
+// (CRTP): it provides
+//   bool LoadROM(std::ifstream & is);
+//   std::size_t GetRamSize() const;
+//   std::optional<uint8_t> RamReadByte(uint64_t addr) const;
+//   bool RamWriteByte(uint64_t addr, uint8_t byte);
+//   void Reset();
+// and may replace Fetch() and Decode(). Nothing is virtual, so for a given machine and backend
+// the whole path inlines; AnyMachine (anymachine.h) type erases it where that is needed.
+template <class tDerived, typename tOp, typename tIns>
 class Machine
 {
 protected:
@@ -31,18 +46,32 @@ protected:
 
     Register<uint64_t> PC;                      // Program Counter
     InstrMap instr;                             // Implemented Instructions
+    uint64_t retired = 0;                       // Instructions executed so far
+    bool fatal = false;                         // Set when the machine can not go on
 
 protected:
-    virtual bool LoadROM(std::ifstream & is) = 0;
+    tDerived & Self() { return static_cast<tDerived &>(*this); };
+    const tDerived & Self() const { return static_cast<const tDerived &>(*this); };
 
-public:
-    virtual std::size_t GetRamSize() const = 0;
-    virtual std::optional<uint8_t> RamReadByte(uint64_t addr) const = 0;
-    virtual bool RamWriteByte(uint64_t addr, uint8_t byte) = 0;
+    // Reads the opcode at PC and advances it. The default goes through RamReadByte, machines
+    // with direct memory access should replace it.
+    std::optional<tOp> Fetch()
+    {
+        tOp opcode = 0;
+        for (std::size_t i=0; i<sizeof(tOp); ++i)
+        {
+            auto byte = Self().RamReadByte(PC);
+            if (!byte)
+                return std::nullopt;
 
-    virtual void Reset() = 0;
+            opcode = (opcode << 8) | byte.value();
+            ++PC;
+        }
+        return opcode;
+    };
 
-    virtual bool LoadROM(const std::string & rom)
+public:
+    bool LoadROM(const std::string & rom)
     {
         std::ifstream is;
 
@@ -57,19 +86,19 @@ public:
         auto length = is.tellg();
         is.seekg(0, std::ios::beg);
 
-        if (length > GetRamSize())
+        if (length > Self().GetRamSize())
         {
             is.close();
             std::cerr << "ROM " << rom << " won't fit on system ram!\n";
             return false;
         }
 
-        auto ret = LoadROM(is);
+        auto ret = Self().LoadROM(is);
         is.close();
         return ret;
     };
 
-    virtual InstrMap::iterator FindBestInstruction(const std::string & sinstr)
+    typename InstrMap::iterator FindBestInstruction(const std::string & sinstr)
     {
         auto best = instr.end();
         int best_matches = 0;
@@ -90,39 +119,56 @@ public:
         return best;
     }
 
-    virtual void Task()
+    uint64_t GetRetired() const { return retired; };
+    uint64_t GetPC() const { return PC; };
+    bool IsRunning() const { return !fatal; };
+
+    // Finds the handler of an opcode, nullptr if there is none
+    const std::function<void(tOp)> * Decode(tOp opcode)
+    {
+        // Converts opcode to string
+        std::stringstream ss;
+        ss << std::hex << std::setw(4) << std::setfill('0') << opcode;
+        auto ix = FindBestInstruction(ss.str());
+        if (ix == instr.end())
+            return nullptr;
+
+        return &ix->second;
+    };
+
+    // Decodes and runs a single opcode. PC must already point to the next instruction.
+    bool Execute(tOp opcode)
     {
-        static bool FATAL = false;
-        if (FATAL)
+        auto handler = Self().Decode(opcode);
+        if (!handler)
+            return false;
+
+        (*handler)(opcode);
+        ++retired;
+        return true;
+    };
+
+    void Task()
+    {
+        if (fatal)
             return;
 
-        std::optional<uint8_t> op[2];
-        for (auto i=0; i<2; ++i)
+        auto op = Self().Fetch();
+        if (!op)
         {
-            if (!(op[i] = RamReadByte(PC)))
-            {
-                std::cerr << "Failed to read memory address 0x" << PC.print_hex() << "!\n";
-                FATAL = true;
-                return;
-            }
-
-            ++PC;
+            std::cerr << "Failed to read memory address " << PC.print_hex() << "!\n";
+            fatal = true;
+            return;
         }
 
-        uint16_t opcode = op[0].value() << 8 | op[1].value();
+        tOp opcode = op.value();
         if (opcode == 0) {
-            FATAL = true;
+            fatal = true;
             return;
         }
 
-        // Converts opcode to string
-        std::stringstream ss;
-        ss << std::hex << std::setw(4) << std::setfill('0') << opcode;
-        auto ix = FindBestInstruction(ss.str());
-        if (ix != instr.end())
-            ix->second(opcode);
-        else
-            FATAL = true;
+        if (!Self().Execute(opcode))
+            fatal = true;
     };
 };
 
@@ -148,13 +194,146 @@ struct CHIP8OpParse
 
 std::ostream& operator<<(std::ostream& os, const struct CHIP8OpParse& Op);
 
-class CHIP8 : public Machine<uint16_t, uint16_t>
+// Opcode -> handler table of CHIP8Core, computed by the compiler. It gives the same answer as the
+// string matching decoder (Machine::FindBestInstruction) on the patterns CHIP8Core registers:
+// the pattern with the most matching digits (N, X and Y match anything), the first one in map
+// order on a tie, so a process never matches strings at run time.
+namespace CHIP8Decoder
 {
-private:
-    const unsigned int MEMORY_FONTS = 0x050;
-    const unsigned int MEMORY_USABLE = 0x200;
-    const unsigned int MEMORY_VIDEO = 0xF00;
-    typedef std::array<uint8_t, 4096> MemorySpecs;
+
+// In std::map order, as the decoder scans them
+constexpr const char * PATTERNS[] = {
+    "00e0", "00ee", "0NNN", "1NNN", "2NNN", "3XNN", "4XNN", "5XY0", "6XNN", "7XNN",
+    "8XY0", "8XY1", "8XY2", "8XY3", "8XY4", "8XY5", "8XY6", "8XY7", "8XYe", "9XY0",
+    "aNNN", "bNNN", "cXNN", "dXYN", "eX9e", "eXa1", "fX07", "fX0a", "fX15", "fX18",
+    "fX1e", "fX29", "fX33", "fX55", "fX65"
+};
+constexpr std::size_t COUNT = sizeof(PATTERNS) / sizeof(PATTERNS[0]);
+
+constexpr uint8_t NONE = 0xff;                  // No digit matches any pattern
+constexpr uint8_t INEXACT = 0x80;               // Best pattern only matches some of the digits
+
+constexpr bool Before(const char * a, const char * b)
+{
+    for (; *a && *a == *b; ++a, ++b)
+        ;
+    return *a < *b;
+}
+
+constexpr char Digit(unsigned int nibble) { return nibble < 10 ? char('0' + nibble) : char('a' + nibble - 10); }
+
+// StrCmp() of the opcode in lowercase hex against a pattern
+constexpr unsigned int Grade(uint16_t op, const char * pattern)
+{
+    unsigned int grade = 0;
+    for (unsigned int i=0; i<4; ++i)
+    {
+        const char digit = Digit((op >> (12 - 4 * i)) & 0xf);
+        const char p = pattern[i];
+        if (p == digit || p == 'N' || p == 'X' || p == 'Y' || p == '*')
+            grade += 1u << (4 - i);
+    }
+    return grade;
+}
+
+// Only a zero second digit is ever matched exactly, so the table leaves out the other values
+constexpr std::size_t Index(uint16_t op)
+{
+    return ((op >> 12) << 9) | (((op >> 8) & 0xf) ? 0x100 : 0) | (op & 0xff);
+}
+
+constexpr std::array<uint8_t, 0x2000> Build()
+{
+    std::array<uint8_t, 0x2000> table{};
+    for (uint32_t i=0; i<table.size(); ++i)
+    {
+        const uint16_t op = ((i >> 9) << 12) | ((i & 0x100) ? 0x100 : 0) | (i & 0xff);
+        unsigned int best = 0;
+        uint8_t ix = NONE;
+        for (std::size_t p=0; p<COUNT; ++p)
+        {
+            // The first digit outweighs the other three: the best pattern always has it
+            if (PATTERNS[p][0] != Digit(op >> 12))
+                continue;
+
+            const auto grade = Grade(op, PATTERNS[p]);
+            if (grade > best)
+            {
+                best = grade;
+                ix = uint8_t(p);
+            }
+        }
+        table[i] = (ix != NONE && best != 30) ? (ix | INEXACT) : ix;
+    }
+    return table;
+}
+
+constexpr bool Valid()
+{
+    for (unsigned int d=0; d<16; ++d)
+    {
+        bool found = false;
+        for (std::size_t p=0; p<COUNT; ++p)
+            found = found || PATTERNS[p][0] == Digit(d);
+        if (!found)
+            return false;
+    }
+
+    for (std::size_t p=0; p<COUNT; ++p)
+    {
+        if (p && !Before(PATTERNS[p - 1], PATTERNS[p]))
+            return false;
+        const char second = PATTERNS[p][1];
+        if (second != '0' && second != 'N' && second != 'X' && second != 'Y')
+            return false;
+    }
+    return true;
+}
+static_assert(Valid(), "PATTERNS must be in std::map order, start with every digit and only fix the second one to 0");
+
+// Built once by the compiler, in machine.cpp
+extern const std::array<uint8_t, 0x2000> TABLE;
+
+}
+
+template <class tBackend>
+class CHIP8Core : public Machine<CHIP8Core<tBackend>, uint16_t, uint16_t>
+{
+    typedef Machine<CHIP8Core<tBackend>, uint16_t, uint16_t> Base;
+    friend Base;
+
+protected:
+    using Base::PC;
+    using Base::instr;
+    using Base::retired;
+    using Base::fatal;
+
+public:
+    static constexpr unsigned int MEMORY_FONTS = 0x050;
+    static constexpr unsigned int MEMORY_USABLE = 0x200;
+    static constexpr unsigned int MEMORY_VIDEO = 0xF00;
+    typedef Memory<4096, 256> MemorySpecs;
+
+    // Blocking instructions (dXYN until the display refresh, fX0a until a key) suspend the machine
+    // instead of being retried. Only a timer tick or the host changing the keys can end a wait,
+    // never a guest instruction, so a suspended machine ends its frame early: the outcome is the
+    // same as spinning on the instruction, at no host cost. The blocked attempt counts as one
+    // retired instruction, the wait as none; GetSuspended() counts the frames that ended waiting.
+    enum class Wait : uint8_t
+    {
+        None,
+        Display,
+        Key
+    };
+
+    // How RunFrame() paces the machine. Instructions runs the number of instructions it is given.
+    // VIP charges every instruction its machine cycles on the COSMAC VIP (see vip.h) against the
+    // budget of a frame, and makes dXYN wait for the vertical blank like the VIP interpreter does.
+    enum class Timing : uint8_t
+    {
+        Instructions,
+        VIP
+    };
 
 protected:
     MemorySpecs ram;                            // 0x000 - 0x200 = RESERVED FOR INTERPRETER (FONTS AT 0x050 ~ 0x09F)
@@ -169,21 +348,205 @@ protected:
     Register<uint16_t> I;                       // The address register, which is named I, is 12 bits wide and is used with several opcodes that
                                                 // involve memory operations.
 
-    std::stack<uint16_t> stack;
+    CallStack<uint16_t> stack;
+
+    std::minstd_rand rng;                       // Per machine, so that runs are reproducible
+    uint32_t seed;                              // Reset() seeds rng with it
+
+    typename tBackend::TimerType delay;         // 60hz timer
+    typename tBackend::AudioType audio;         // 60hz timer with audio
+    typename tBackend::TimerType disp_wait;     // 60hz display refresh
+
+    typename tBackend::InputType input;
 
-    TimerSDL<uint8_t, 60> delay;                // 60hz timer
-    TimerAudioSDL<uint8_t, 60> audio;           // 60hz timer with audio
-    TimerSDL<uint8_t, 60> disp_wait;            // 60hz display refresh
+    typename tBackend::DisplayType display;
 
-    InputSDL input;
+    // Decode cache, one entry per address. An entry may cover a fused sequence of instructions.
+    struct Decoded
+    {
+        enum class Kind : uint8_t
+        {
+            Empty,
+            Single,                             // Any instruction, through its handler
+            LoadRun,                            // 6XNN 6XNN [6XNN [6XNN]]
+            LoadIDraw,                          // aNNN dXYN
+            TimerPoll,                          // fX07 3XNN 1NNN, jumping back to the fX07
+            CountLoop                           // 7XNN 3XNN
+        };
+
+        Kind kind = Kind::Empty;
+        uint8_t count = 0;                      // Guest instructions covered
+        uint16_t op[4] = {};
+        const std::function<void(uint16_t)> * fn = nullptr;  // Handler of op[count - 1]
+        uint64_t generation = 0;                // Page generations when decoded
+    };
+
+    static constexpr std::size_t MAX_FUSED = 4;
 
-    DisplaySDL display;
+    std::vector<Decoded> decoded;
+    std::array<const std::function<void(uint16_t)> *, CHIP8Decoder::COUNT> handlers;  // Of CHIP8Decoder::PATTERNS
+    std::bitset<0x10000> reported;              // Opcodes that got the "No match" message
+    bool fusion;
+    Wait waiting;                               // Set by a blocked instruction, PC still on it
+    bool key_logged;                            // fX0a logged the wait it is in
+    Timing timing;
+    uint64_t dispatches;
+    uint64_t suspended;                         // Frames that ended with the machine waiting
+    uint64_t limit;                             // No fused entry may retire past this
+    std::bitset<MemorySpecs::Size> * coverage;  // Addresses of executed instructions, optional
+
+    std::array<uint8_t, MemorySpecs::Size> baseline;        // RAM image ResetToBaseline() goes back to
+    std::array<uint32_t, MemorySpecs::Pages> baseline_gen;  // Page generations matching it
 
 protected:
-    virtual bool LoadROM(std::ifstream & is);
+    bool LoadROM(std::ifstream & is);
+
+    uint64_t Generations(uint64_t addr, uint8_t count) const
+    {
+        return (uint64_t(ram.Generation(addr)) << 32) | ram.Generation(addr + 2 * count - 1);
+    }
+
+    uint16_t OpAt(uint64_t addr) const { return uint16_t(ram.Read(addr) << 8 | ram.Read(addr + 1)); };
+
+    // Whether a suspended machine still can not resume
+    bool Blocked()
+    {
+        return waiting == Wait::Display ? disp_wait.Get() > (timing == Timing::VIP ? 1 : 0) : input.GetKey() == Input::Key::_invalid;
+    }
+
+    // Table lookup in place of the string matching decoder (see CHIP8Decoder)
+    const std::function<void(uint16_t)> * Decode(uint16_t opcode)
+    {
+        const auto ix = CHIP8Decoder::TABLE[CHIP8Decoder::Index(opcode)];
+        if ((ix & CHIP8Decoder::INEXACT) && !reported[opcode])
+        {
+            reported[opcode] = true;
+            char hex[8];
+            std::snprintf(hex, sizeof(hex), "%04x", opcode);
+            std::cout << "No match found for " << hex << "!\n";
+        }
+        return ix == CHIP8Decoder::NONE ? nullptr : handlers[ix & ~CHIP8Decoder::INEXACT];
+    }
+
+    // Looks for a fusable sequence starting at addr with op[0] already fetched
+    void Fuse(uint64_t addr, Decoded & d)
+    {
+        if (addr + 2 * MAX_FUSED > ram.size())
+            return;
+
+        uint16_t next[MAX_FUSED];
+        for (std::size_t i=0; i<MAX_FUSED; ++i)
+            next[i] = OpAt(addr + 2 * i);
+
+        auto is = [](uint16_t op, uint16_t pattern, uint16_t mask) { return (op & mask) == pattern; };
+        const CHIP8OpParse p0(next[0]), p1(next[1]), p2(next[2]);
+
+        if (is(next[0], 0x6000, 0xf000) && is(next[1], 0x6000, 0xf000))
+        {
+            d.kind = Decoded::Kind::LoadRun;
+            d.count = 2;
+            while (d.count < MAX_FUSED && is(next[d.count], 0x6000, 0xf000))
+                ++d.count;
+        }
+        else if (is(next[0], 0xa000, 0xf000) && is(next[1], 0xd000, 0xf000))
+        {
+            d.kind = Decoded::Kind::LoadIDraw;
+            d.count = 2;
+        }
+        else if (is(next[0], 0xf007, 0xf0ff) && is(next[1], 0x3000, 0xf000) && is(next[2], 0x1000, 0xf000)
+                 && p1.X == p0.X && p2.NNN == addr)
+        {
+            d.kind = Decoded::Kind::TimerPoll;
+            d.count = 3;
+        }
+        else if (is(next[0], 0x7000, 0xf000) && is(next[1], 0x3000, 0xf000) && p1.X == p0.X)
+        {
+            d.kind = Decoded::Kind::CountLoop;
+            d.count = 2;
+        }
+        else
+            return;
+
+        std::copy(next, next + d.count, d.op);
+        d.fn = Decode(d.op[d.count - 1]);
+        if (!d.fn)
+        {
+            d.kind = Decoded::Kind::Empty;
+            d.count = 1;
+        }
+    }
+
+    // Returns the decode cache entry for addr, building it if needed. Entries are rebuilt when
+    // the bytes they were decoded from changed.
+    const Decoded * Lookup(uint64_t addr)
+    {
+        if (addr + 1 >= ram.size() || decoded.empty())
+            return nullptr;
+
+        auto & d = decoded[addr];
+        if (d.kind != Decoded::Kind::Empty)
+        {
+            const auto gen = Generations(addr, d.count);
+            if (d.generation == gen)
+                return &d;
+
+            // Page written: still good if our own bytes are untouched
+            bool same = true;
+            for (auto i=0; i<d.count && same; ++i)
+                same = OpAt(addr + 2 * i) == d.op[i];
+            if (same)
+            {
+                d.generation = gen;
+                return &d;
+            }
+        }
+
+        CHIP8_PROBE(Decode);
+        d = Decoded{ Decoded::Kind::Empty, 1, { OpAt(addr) }, nullptr, 0 };
+        if (d.op[0] == 0)
+            return nullptr;
+
+        if (fusion)
+            Fuse(addr, d);
+
+        if (d.kind == Decoded::Kind::Empty)
+        {
+            d.fn = Decode(d.op[0]);
+            if (!d.fn)
+                return nullptr;
+            d.kind = Decoded::Kind::Single;
+        }
+
+        d.generation = Generations(addr, d.count);
+        return &d;
+    }
+
+    // Decodes every instruction slot of the ROM image up front
+    void Predecode(std::size_t size)
+    {
+        for (auto addr = MEMORY_USABLE; addr + 1 < MEMORY_USABLE + size; addr += 2)
+            Lookup(addr);
+    }
+
+    std::optional<uint16_t> Fetch()
+    {
+        // Fast path: both opcode bytes on the same directly mapped page
+        if (auto p = ram.FetchPtr(PC); p && (PC % MemorySpecs::PageSize) != MemorySpecs::PageSize - 1)
+        {
+            PC += 2;
+            return uint16_t(p[0] << 8 | p[1]);
+        }
+
+        return Base::Fetch();
+    };
 
 public:
-    CHIP8() : ram{}, V{}, I{}, delay{}, audio{600}, disp_wait{}, input{}, display{64, 32, 10}
+    using Base::LoadROM;
+    using Base::IsRunning;
+    using Base::GetRetired;
+
+    CHIP8Core() : ram{}, V{}, I{}, seed{12345}, delay{}, audio{600}, disp_wait{}, input{}, display{64, 32, 10},
+                  decoded(MemorySpecs::Size), handlers{}, reported{}, fusion{true}, waiting{Wait::None}, key_logged{false}, timing{Timing::Instructions}, dispatches{0}, suspended{0}, limit{std::numeric_limits<uint64_t>::max()}, coverage{nullptr}
     {
         std::array<uint8_t, 16*5> builtin_fonts
         {
@@ -205,20 +568,21 @@ public:
             0xF0, 0x80, 0xF0, 0x80, 0xF0, // E
             0xF0, 0x80, 0xF0, 0x80, 0x80  // F
         };
-        std::move(builtin_fonts.begin(), builtin_fonts.end(), ram.begin() + MEMORY_FONTS);
+        ram.CopyIn(MEMORY_FONTS, builtin_fonts.begin(), builtin_fonts.end());
+        SetBaseline();
 
         instr["0NNN"] = [this](CHIP8OpParse op)
         {
-            debug << op << "Calls machine code routine at address 0x" << std::hex << +op.NNN << "\n";
+            if (debug) debug << op << "Calls machine code routine at address 0x" << std::hex << +op.NNN << "\n";
         };
         instr["00e0"] = [this](CHIP8OpParse op)
         {
-            debug << op << "Clears the screen\n";
-            Instructions::ClearDisplay<MemorySpecs::iterator>(ram.begin() + MEMORY_VIDEO, display.GetW(), display.GetH());
+            if (debug) debug << op << "Clears the screen\n";
+            Instructions::ClearDisplay(ram, MEMORY_VIDEO, display.GetW(), display.GetH());
         };
         instr["00ee"] = [this](CHIP8OpParse op)
         {
-            debug << op << "Returns from a subroutine\n";
+            if (debug) debug << op << "Returns from a subroutine\n";
 
             if (stack.size() == 0)
                 return;
@@ -228,213 +592,540 @@ public:
         };
         instr["1NNN"] = [this](CHIP8OpParse op)
         {
-            debug << op << "Jumps to address 0x" << std::hex << +op.NNN << "\n";
+            if (debug) debug << op << "Jumps to address 0x" << std::hex << +op.NNN << "\n";
             Instructions::AssignV<uint64_t, uint16_t>(&PC, op.NNN);
         };
         instr["2NNN"] = [this](CHIP8OpParse op)
         {
-            debug << op << "Calls subroutine at 0x" << std::hex << +op.NNN << "\n";
+            if (debug) debug << op << "Calls subroutine at 0x" << std::hex << +op.NNN << "\n";
+            if (stack.full())
+            {
+                PC -= 2;
+                std::cerr << "Stack overflow at " << PC.print_hex() << "!\n";
+                fatal = true;
+                return;
+            }
             stack.push(PC);
             Instructions::AssignV<uint64_t, uint16_t>(&PC, op.NNN);
         };
         instr["3XNN"] = [this](CHIP8OpParse op)
         {
-            debug << op << "Skips the next instruction if V" << std::hex << +op.X << " (" << V[op.X].print_hex() << ") equals 0x" << std::hex << +op.NN << "\n";
+            if (debug) debug << op << "Skips the next instruction if V" << std::hex << +op.X << " (" << V[op.X].print_hex() << ") equals 0x" << std::hex << +op.NN << "\n";
             Instructions::SkipNext(&PC, (V[op.X] == op.NN));
         };
         instr["4XNN"] = [this](CHIP8OpParse op)
         {
-            debug << op << "Skips the next instruction if V" << std::hex << +op.X << " (" << V[op.X].print_hex() << ") does not equal 0x" << std::hex << +op.NN << "\n";
+            if (debug) debug << op << "Skips the next instruction if V" << std::hex << +op.X << " (" << V[op.X].print_hex() << ") does not equal 0x" << std::hex << +op.NN << "\n";
             Instructions::SkipNext(&PC, (V[op.X] != op.NN));
         };
         instr["5XY0"] = [this](CHIP8OpParse op)
         {
-            debug << op << "Skips the next instruction if V" << std::hex << +op.X << " (" << V[op.X].print_hex() << ") equals V" << std::hex << +op.Y << " (" << V[op.Y].print_hex() << ")\n";
+            if (debug) debug << op << "Skips the next instruction if V" << std::hex << +op.X << " (" << V[op.X].print_hex() << ") equals V" << std::hex << +op.Y << " (" << V[op.Y].print_hex() << ")\n";
             Instructions::SkipNext(&PC, (V[op.X] == V[op.Y]));
         };
         instr["6XNN"] = [this](CHIP8OpParse op)
         {
-            debug << op << "Sets V" << std::hex << +op.X << " (" << V[op.X].print_hex() << ") to " << std::dec << +op.NN << "\n";
+            if (debug) debug << op << "Sets V" << std::hex << +op.X << " (" << V[op.X].print_hex() << ") to " << std::dec << +op.NN << "\n";
             Instructions::AssignV<uint8_t, uint8_t>(&V[op.X], op.NN);
         };
         instr["7XNN"] = [this](CHIP8OpParse op)
         {
-            debug << op << "Adds " << std::dec << +op.NN << " to V" << std::hex << +op.X << " (" << V[op.X].print_hex() << ") (VF is not changed)\n";
+            if (debug) debug << op << "Adds " << std::dec << +op.NN << " to V" << std::hex << +op.X << " (" << V[op.X].print_hex() << ") (VF is not changed)\n";
             Instructions::AddV<uint8_t, uint8_t>(&V[op.X], op.NN, nullptr);
         };
         instr["8XY0"] = [this](CHIP8OpParse op)
         {
-            debug << op << "Sets V" << std::hex << +op.X << " (" << V[op.X].print_hex() << ") to the value of V" << std::hex << +op.Y << " (" << V[op.Y].print_hex() << ")\n";
+            if (debug) debug << op << "Sets V" << std::hex << +op.X << " (" << V[op.X].print_hex() << ") to the value of V" << std::hex << +op.Y << " (" << V[op.Y].print_hex() << ")\n";
             Instructions::Assign<uint8_t, uint8_t>(&V[op.X], &V[op.Y]);
         };
         instr["8XY1"] = [this](CHIP8OpParse op)
         {
-            debug << op << "Sets V" << std::hex << +op.X << " (" << V[op.X].print_hex() << ") to V" << std::hex << +op.X << " (" << V[op.X].print_hex() << ") or V" << std::hex << +op.Y << " (" << V[op.Y].print_hex() << ")\n";
+            if (debug) debug << op << "Sets V" << std::hex << +op.X << " (" << V[op.X].print_hex() << ") to V" << std::hex << +op.X << " (" << V[op.X].print_hex() << ") or V" << std::hex << +op.Y << " (" << V[op.Y].print_hex() << ")\n";
             Instructions::AssignV<uint8_t, uint8_t>(&V[op.X], V[op.X] | V[op.Y]);
             V[0xf] = 0;
         };
         instr["8XY2"] = [this](CHIP8OpParse op)
         {
-            debug << op << "Sets V" << std::hex << +op.X << " (" << V[op.X].print_hex() << ") to V" << std::hex << +op.X << " (" << V[op.X].print_hex() << ") and V" << std::hex << +op.Y << " (" << V[op.Y].print_hex() << ")\n";
+            if (debug) debug << op << "Sets V" << std::hex << +op.X << " (" << V[op.X].print_hex() << ") to V" << std::hex << +op.X << " (" << V[op.X].print_hex() << ") and V" << std::hex << +op.Y << " (" << V[op.Y].print_hex() << ")\n";
             Instructions::AssignV<uint8_t, uint8_t>(&V[op.X], V[op.X] & V[op.Y]);
             V[0xf] = 0;
         };
         instr["8XY3"] = [this](CHIP8OpParse op)
         {
-            debug << op << "Sets V" << std::hex << +op.X << " (" << V[op.X].print_hex() << ") to V" << std::hex << +op.X << " (" << V[op.X].print_hex() << ") xor V" << std::hex << +op.Y << " (" << V[op.Y].print_hex() << ")\n";
+            if (debug) debug << op << "Sets V" << std::hex << +op.X << " (" << V[op.X].print_hex() << ") to V" << std::hex << +op.X << " (" << V[op.X].print_hex() << ") xor V" << std::hex << +op.Y << " (" << V[op.Y].print_hex() << ")\n";
             Instructions::AssignV<uint8_t, uint8_t>(&V[op.X], V[op.X] ^ V[op.Y]);
             V[0xf] = 0;
         };
         instr["8XY4"] = [this](CHIP8OpParse op)
         {
-            debug << op << "8XY4: Adds V" << std::hex << +op.Y << " (" << V[op.Y].print_hex() << ") to V" << std::hex << +op.X << " (" << V[op.X].print_hex() << "). VF is set to 1 when there's an overflow, and to 0 when there is not\n";
+            if (debug) debug << op << "8XY4: Adds V" << std::hex << +op.Y << " (" << V[op.Y].print_hex() << ") to V" << std::hex << +op.X << " (" << V[op.X].print_hex() << "). VF is set to 1 when there's an overflow, and to 0 when there is not\n";
             Instructions::Add<uint8_t, uint8_t>(&V[op.X], &V[op.Y], &V[0xf]);
         };
         instr["8XY5"] = [this](CHIP8OpParse op)
         {
-            debug << op << "V" << std::hex << +op.Y << " (" << V[op.Y].print_hex() << ") is subtracted from V" << std::hex << +op.X << " (" << V[op.X].print_hex() << "). VF is set to 0 when there's an underflow, and 1 when there is not\n";
+            if (debug) debug << op << "V" << std::hex << +op.Y << " (" << V[op.Y].print_hex() << ") is subtracted from V" << std::hex << +op.X << " (" << V[op.X].print_hex() << "). VF is set to 0 when there's an underflow, and 1 when there is not\n";
             Instructions::Sub<uint8_t, uint8_t>(&V[op.X], &V[op.Y], &V[0xf]);
         };
         instr["8XY6"] = [this](CHIP8OpParse op)
         {
             V[op.X] = (uint8_t)V[op.Y];
-            debug << op << "Shifts V" << std::hex << +op.X << " (" << V[op.X].print_hex() << ") to the right by 1, then stores the least significant bit of V" << std::hex << +op.X << " (" << V[op.X].print_hex() << ") prior to the shift into VF\n";
+            if (debug) debug << op << "Shifts V" << std::hex << +op.X << " (" << V[op.X].print_hex() << ") to the right by 1, then stores the least significant bit of V" << std::hex << +op.X << " (" << V[op.X].print_hex() << ") prior to the shift into VF\n";
             Instructions::RShiftV<uint8_t, uint8_t>(&V[op.X], 1, &V[0xf]);
         };
         instr["8XY7"] = [this](CHIP8OpParse op)
         {
-            debug << op << "Sets V" << std::hex << +op.X << " (" << V[op.X].print_hex() << ") to V" << std::hex << +op.Y << " (" << V[op.Y].print_hex() << ") minus V" << std::hex << +op.X << " (" << V[op.X].print_hex() << "). VF is set to 0 when there's an underflow, and 1 when there is not\n";
+            if (debug) debug << op << "Sets V" << std::hex << +op.X << " (" << V[op.X].print_hex() << ") to V" << std::hex << +op.Y << " (" << V[op.Y].print_hex() << ") minus V" << std::hex << +op.X << " (" << V[op.X].print_hex() << "). VF is set to 0 when there's an underflow, and 1 when there is not\n";
             Instructions::SubVAlt<uint8_t, uint8_t>(&V[op.X], V[op.Y], &V[0xf]);
         };
         instr["8XYe"] = [this](CHIP8OpParse op)
         {
             V[op.X] = (uint8_t)V[op.Y];
-            debug << op << "Shifts V" << std::hex << +op.X << " (" << V[op.X].print_hex() << ") to the left by 1, then sets VF to 1 if the most significant bit of V" << std::hex << +op.X << " (" << V[op.X].print_hex() << ") prior to that shift was set, or to 0 if it was unset\n";
+            if (debug) debug << op << "Shifts V" << std::hex << +op.X << " (" << V[op.X].print_hex() << ") to the left by 1, then sets VF to 1 if the most significant bit of V" << std::hex << +op.X << " (" << V[op.X].print_hex() << ") prior to that shift was set, or to 0 if it was unset\n";
             Instructions::LShiftV<uint8_t, uint8_t>(&V[op.X], 1, &V[0xf]);
         };
         instr["9XY0"] = [this](CHIP8OpParse op)
         {
-            debug << op << "Skips the next instruction if V" << std::hex << +op.X << " (" << V[op.X].print_hex() << ") does not equal VV" << std::hex << +op.Y << " (" << V[op.Y].print_hex() << ")\n";
+            if (debug) debug << op << "Skips the next instruction if V" << std::hex << +op.X << " (" << V[op.X].print_hex() << ") does not equal VV" << std::hex << +op.Y << " (" << V[op.Y].print_hex() << ")\n";
             Instructions::SkipNext(&PC, (V[op.X] != V[op.Y]));
         };
         instr["aNNN"] = [this](CHIP8OpParse op)
         {
-            debug << op << "Sets I to the address 0x" << std::hex << +op.NNN << "\n";
+            if (debug) debug << op << "Sets I to the address 0x" << std::hex << +op.NNN << "\n";
             Instructions::AssignV<uint16_t, uint16_t>(&I, op.NNN);
         };
         instr["bNNN"] = [this](CHIP8OpParse op)
         {
             uint8_t target_register = op.X; // 0;
-            debug << op << "Jumps to the address 0x" << std::hex << +op.NNN << " plus V" << std::hex << +target_register << " (0x" << std::hex << V[target_register] << ")\n";
+            if (debug) debug << op << "Jumps to the address 0x" << std::hex << +op.NNN << " plus V" << std::hex << +target_register << " (0x" << std::hex << V[target_register] << ")\n";
             Instructions::Jump(&PC, op.NNN + V[0]);
         };
         instr["cXNN"] = [this](CHIP8OpParse op)
         {
-            debug << op << "Sets V" << std::hex << +op.X << " (" << V[op.X].print_hex() << ") to the result of a bitwise and operation on a random number and 0x" << std::hex << +op.NN << "\n";
-            Instructions::AssignV<uint8_t, uint8_t>(&V[op.X], uint8_t(std::rand() & 0xff) & op.NN);
+            if (debug) debug << op << "Sets V" << std::hex << +op.X << " (" << V[op.X].print_hex() << ") to the result of a bitwise and operation on a random number and 0x" << std::hex << +op.NN << "\n";
+            Instructions::AssignV<uint8_t, uint8_t>(&V[op.X], uint8_t(rng() & 0xff) & op.NN);
         };
         instr["dXYN"] = [this](CHIP8OpParse op)
         {
-            if (disp_wait.Get())
+            // The VIP interpreter waits for the vertical blank before every sprite: disp_wait is
+            // 2 until the blank, which leaves it at 1 for the sprite to go. The default timing
+            // only waits once a sprite was drawn in the frame.
+            if (timing == Timing::VIP ? disp_wait.Get() != 1 : disp_wait.Get() != 0)
             {
+                if (timing == Timing::VIP)
+                    disp_wait.Set(2);
                 PC -= 2;
+                waiting = Wait::Display;
                 return;
             }
 
-            debug << op << "Draws a sprite at coordinate x=V" << std::hex << +op.X << " (" << V[op.X].print_dec() << ") and y=V" << std::hex << +op.Y << " (" << V[op.Y].print_dec() << ") with width of 8 by height of " << std::dec << +op.N << " pixels\n";
-            Instructions::Draw<MemorySpecs::iterator, uint8_t>(ram.begin(), ram.begin() + MEMORY_VIDEO, V[0xF], V[op.X], V[op.Y], I, op.N, display.GetW(), display.GetH());
+            if (debug) debug << op << "Draws a sprite at coordinate x=V" << std::hex << +op.X << " (" << V[op.X].print_dec() << ") and y=V" << std::hex << +op.Y << " (" << V[op.Y].print_dec() << ") with width of 8 by height of " << std::dec << +op.N << " pixels\n";
+            {
+                CHIP8_PROBE(GuestDraw);
+                Instructions::Draw(ram, MEMORY_VIDEO, V[0xF], V[op.X], V[op.Y], I, op.N, display.GetW(), display.GetH());
+            }
 
-            display.Draw(ram.begin() + MEMORY_VIDEO, ram.begin() + MEMORY_VIDEO + display.GetW() * display.GetH());
-            disp_wait.Set(1);
+            // Presenting is up to the host, from the video area, once per frame
+            disp_wait.Set(timing == Timing::VIP ? 0 : 1);
         };
         instr["eX9e"] = [this](CHIP8OpParse op)
         {
-            debug << op << "Skips the next instruction if the key stored in V" << std::hex << +op.X << " (" << V[op.X].print_hex() << ") is pressed\n";
+            if (debug) debug << op << "Skips the next instruction if the key stored in V" << std::hex << +op.X << " (" << V[op.X].print_hex() << ") is pressed\n";
             Instructions::SkipNext(&PC, (input.IsPressed(Input::Key(uint8_t(V[op.X])))));
         };
         instr["eXa1"] = [this](CHIP8OpParse op)
         {
-            debug << op << "Skips the next instruction if the key stored in V" << std::hex << +op.X << " (" << V[op.X].print_hex() << ") is not pressed\n";
+            if (debug) debug << op << "Skips the next instruction if the key stored in V" << std::hex << +op.X << " (" << V[op.X].print_hex() << ") is not pressed\n";
             Instructions::SkipNext(&PC, (!input.IsPressed(Input::Key(uint8_t(V[op.X])))));
         };
         instr["fX07"] = [this](CHIP8OpParse op)
         {
-            debug << op << "Sets V" << std::hex << +op.X << " (" << V[op.X].print_hex() << ") to the value of the delay timer (" << std::dec << +delay.Get() << ")\n";
+            if (debug) debug << op << "Sets V" << std::hex << +op.X << " (" << V[op.X].print_hex() << ") to the value of the delay timer (" << std::dec << +delay.Get() << ")\n";
             Instructions::AssignV<uint8_t, uint8_t>(&V[op.X], delay.Get());
         };
         instr["fX0a"] = [this](CHIP8OpParse op)
         {
-            static bool msg_showed = false;
-            if (!msg_showed) {
-                debug << op << "A key press is awaited, and then stored in V" << std::hex << +op.X << " (" << V[op.X].print_hex() << ") (blocking operation)\n";
-                msg_showed = true;
+            if (!key_logged) {
+                if (debug) debug << op << "A key press is awaited, and then stored in V" << std::hex << +op.X << " (" << V[op.X].print_hex() << ") (blocking operation)\n";
+                key_logged = true;
             }
 
-            auto key = input.GetKey(false);
+            auto key = input.GetKey();
             if (key == Input::Key::_invalid)
             {
                 PC -= 2;
+                waiting = Wait::Key;
                 return;
             }
             Instructions::AssignV<uint8_t, uint8_t>(&V[op.X], uint8_t(key));
-            msg_showed = false;
+            key_logged = false;
         };
         instr["fX15"] = [this](CHIP8OpParse op)
         {
-            debug << op << "Sets the delay timer (" << std::dec << +delay.Get() << ") to V" << std::hex << +op.X << " (" << V[op.X].print_hex() << ")\n";
+            if (debug) debug << op << "Sets the delay timer (" << std::dec << +delay.Get() << ") to V" << std::hex << +op.X << " (" << V[op.X].print_hex() << ")\n";
             delay.Set(V[op.X]);
         };
         instr["fX18"] = [this](CHIP8OpParse op)
         {
-            debug << op << "Sets the sound timer to V" << std::hex << +op.X << " (" << V[op.X].print_hex() << ")\n";
+            if (debug) debug << op << "Sets the sound timer to V" << std::hex << +op.X << " (" << V[op.X].print_hex() << ")\n";
             audio.Set(V[op.X]);
         };
         instr["fX1e"] = [this](CHIP8OpParse op)
         {
-            debug << op << "Adds V" << std::hex << +op.X << " (" << V[op.X].print_hex() << ") to I. VF is not affected\n";
+            if (debug) debug << op << "Adds V" << std::hex << +op.X << " (" << V[op.X].print_hex() << ") to I. VF is not affected\n";
             Instructions::AddV<uint16_t, uint8_t>(&I, V[op.X], nullptr);
         };
         instr["fX29"] = [this](CHIP8OpParse op)
         {
-            debug << op << "Sets I to the location of the sprite for the character in V" << std::hex << +op.X << " (" << V[op.X].print_hex() << ")\n";
+            if (debug) debug << op << "Sets I to the location of the sprite for the character in V" << std::hex << +op.X << " (" << V[op.X].print_hex() << ")\n";
             I = MEMORY_FONTS + ((uint8_t)V[op.X] * 5);
         };
         instr["fX33"] = [this](CHIP8OpParse op)
         {
-            debug << op << "Stores the binary-coded decimal representation of V" << std::hex << +op.X << " (" << V[op.X].print_hex() << ")\n";
-            Instructions::BCD<MemorySpecs::iterator>(ram.begin(), V[op.X], I);
+            if (debug) debug << op << "Stores the binary-coded decimal representation of V" << std::hex << +op.X << " (" << V[op.X].print_hex() << ")\n";
+            Instructions::BCD(ram, V[op.X], I);
         };
         instr["fX55"] = [this](CHIP8OpParse op)
         {
-            debug << op << "Stores from V0 to V" << std::hex << +op.X << " (" << V[op.X].print_hex() << ") (including Vx) in memory, starting at address I\n";
-            Instructions::Store<MemorySpecs::iterator, uint8_t, uint8_t, 16>(ram.begin(), I, op.X, &V);
+            if (debug) debug << op << "Stores from V0 to V" << std::hex << +op.X << " (" << V[op.X].print_hex() << ") (including Vx) in memory, starting at address I\n";
+            Instructions::Store<MemorySpecs, uint8_t, uint8_t, 16>(ram, I, op.X, &V);
             I += op.X + 1;
         };
         instr["fX65"] = [this](CHIP8OpParse op)
         {
-            debug << op << "Fills from V0 to V" << std::hex << +op.X << " (" << V[op.X].print_hex() << ") (including Vx) with values from memory, starting at address I\n";
-            Instructions::Fill<MemorySpecs::iterator, uint8_t, uint8_t, 16>(ram.begin(), I, op.X, &V);
+            if (debug) debug << op << "Fills from V0 to V" << std::hex << +op.X << " (" << V[op.X].print_hex() << ") (including Vx) with values from memory, starting at address I\n";
+            Instructions::Fill<MemorySpecs, uint8_t, uint8_t, 16>(ram, I, op.X, &V);
             I += op.X + 1;
         };
 
+        for (std::size_t p=0; p<CHIP8Decoder::COUNT; ++p)
+            handlers[p] = &instr.at(CHIP8Decoder::PATTERNS[p]);
+
         Reset();
     };
 
-    virtual std::size_t GetRamSize() const { return (ram.size() - MEMORY_USABLE); };
-    virtual std::optional<uint8_t> RamReadByte(uint64_t addr) const { if (addr >= ram.size()) return std::nullopt; return ram.at(addr); };
-    virtual bool RamWriteByte(uint64_t addr, uint8_t byte) { if (addr >= ram.size()) return false; ram[addr] = byte; return true; };
+    std::size_t GetRamSize() const { return (ram.size() - MEMORY_USABLE); };
+    std::optional<uint8_t> RamReadByte(uint64_t addr) const { return ram.ReadChecked(addr); };
+    bool RamWriteByte(uint64_t addr, uint8_t byte) { return ram.WriteChecked(addr, byte); };
 
-    virtual void Reset()
+    void Reset()
     {
+        fatal = false;
+        waiting = Wait::None;
         PC = MEMORY_USABLE;
-        std::srand(12345);
+        rng.seed(seed);
+    }
+
+    // Makes the current RAM contents what ResetToBaseline() restores: the fonts after
+    // construction, typically the fonts and a ROM after LoadROM()
+    void SetBaseline()
+    {
+        std::copy(ram.begin(), ram.end(), baseline.begin());
+        for (std::size_t p=0; p<MemorySpecs::Pages; ++p)
+            baseline_gen[p] = ram.Generation(p * MemorySpecs::PageSize);
+    }
+
+    // Complete reset: RAM back to the baseline, registers, stack and timers cleared, then Reset().
+    // Only the pages written since the baseline was set or last restored are copied, so the cost
+    // follows what the program touched. Returns the number of pages restored.
+    std::size_t ResetToBaseline()
+    {
+        std::size_t restored = 0;
+        for (std::size_t p=0; p<MemorySpecs::Pages; ++p)
+        {
+            const auto addr = p * MemorySpecs::PageSize;
+            if (ram.Generation(addr) == baseline_gen[p])
+                continue;
+
+            ram.CopyIn(addr, baseline.begin() + addr, baseline.begin() + addr + MemorySpecs::PageSize);
+            baseline_gen[p] = ram.Generation(addr);
+            ++restored;
+        }
+
+        for (auto & v : V)
+            v = 0;
+        I = 0;
+        stack.clear();
+        delay.Set(0);
+        audio.Set(0);
+        disp_wait.Set(0);
+        Reset();
+        return restored;
+    }
+
+    // Takes effect on the next Reset()
+    void SetSeed(uint32_t s) { seed = s; };
+    uint32_t GetSeed() const { return seed; };
+
+    // Loads a ROM image already in memory. Unlike the file loader it does not probe for a key map.
+    bool LoadROM(const uint8_t * rom, std::size_t size)
+    {
+        if (size > GetRamSize())
+            return false;
+
+        ram.CopyIn(MEMORY_USABLE, rom, rom + size);
+        Predecode(size);
+        return true;
+    }
+
+    // Only for backends whose timers are not driven by the host (see headless.h)
+    void TickTimers()
+    {
+        delay.Tick();
+        audio.Tick();
+        disp_wait.Tick();
+    }
+
+    // Runs one 60hz frame and then ticks the timers, the vertical blank. With Timing::VIP `ipf`
+    // is not used: the frame runs as many instructions as fit in the cycle budget of the VIP.
+    void RunFrame(unsigned int ipf)
+    {
+        CHIP8_PROBE(Execute);
+        if (timing == Timing::VIP)
+        {
+            RunFrameCycles();
+            return;
+        }
+
+        const auto target = retired + ipf;
+        SetLimit(target);
+        while (retired < target && IsRunning() && !Suspended())
+            Task();
+        SetLimit(std::numeric_limits<uint64_t>::max());
+        suspended += (waiting != Wait::None);
+        TickTimers();
+    }
+
+    // An instruction runs if its cycles fit in what is left of the frame, or if it is the first
+    // one of the frame; otherwise it waits for the next frame, as does a suspended machine. No
+    // cycles are carried between frames, so a frame depends on the machine state alone and saved
+    // states resume exactly.
+    void RunFrameCycles()
+    {
+        unsigned int left = VIP::BUDGET;
+        bool first = true;
+        while (IsRunning() && (waiting == Wait::None || !Blocked()))
+        {
+            const uint16_t op = OpAt(PC);
+            const unsigned int cost = VIP::Cycles(op, V[(op >> 8) & 0xf]);
+            if (cost > left && !first)
+                break;
+
+            SetLimit(retired + 1);
+            Task();
+            if (waiting != Wait::None)
+                break;
+            left -= std::min(cost, left);
+            first = false;
+        }
+        SetLimit(std::numeric_limits<uint64_t>::max());
+        suspended += (waiting != Wait::None);
+        TickTimers();
+    }
+
+    // Takes effect on the next frame
+    void SetTiming(Timing t) { timing = t; };
+    Timing GetTiming() const { return timing; };
+
+    // For callers driving Task() themselves: no fused entry retires past this instruction count
+    void SetLimit(uint64_t l) { limit = l; };
+
+    void SaveState(CHIP8State & s) const
+    {
+        std::copy(ram.begin(), ram.end(), s.ram.begin());
+        std::transform(V.begin(), V.end(), s.V.begin(), [](auto v) { return uint8_t(v); });
+        s.I = I;
+        s.PC = PC;
+
+        s.stack.assign(stack.begin(), stack.end());
+
+        s.delay = delay.Get();
+        s.sound = audio.Get();
+        s.disp_wait = disp_wait.Get();
+        s.rng = rng;
+    }
+
+    void LoadState(const CHIP8State & s)
+    {
+        ram.Update(0, s.ram.begin(), s.ram.end());
+        std::copy(s.V.begin(), s.V.end(), V.begin());
+        I = s.I;
+        PC = s.PC;
+
+        stack.clear();
+        for (auto v : s.stack)
+            stack.push(v);
+
+        delay.Set(s.delay);
+        audio.Set(s.sound);
+        disp_wait.Set(s.disp_wait);
+        rng = s.rng;
+        fatal = false;
+        waiting = Wait::None;
+    }
+
+    // Superinstruction fusion in the decode stage, on by default
+    void SetFusion(bool enable)
+    {
+        fusion = enable;
+        std::fill(decoded.begin(), decoded.end(), Decoded{});
+    }
+
+    uint64_t GetDispatches() const { return dispatches; };
+
+    // Records the address of every instruction executed from now on into the given bitmap
+    void SetCoverage(std::bitset<MemorySpecs::Size> * bitmap) { coverage = bitmap; };
+
+    // Hash of the same state CHIP8State::Hash covers. RAM and stack hashes are kept up to date
+    // on every write; the fixed size register file is folded in here, so this is O(1).
+    uint64_t StateHash() const
+    {
+        using namespace ::StateHash;
+
+        uint64_t h = ram.Hash() ^ stack.Hash();
+        for (std::size_t i=0; i<V.size(); ++i)
+            h ^= Word(KEY_V + i, uint8_t(V[i]));
+
+        return h ^ Word(KEY_I, uint16_t(I)) ^ Word(KEY_PC, uint64_t(PC)) ^ Word(KEY_DELAY, delay.Get()) ^ Word(KEY_SOUND, audio.Get()) ^ Word(KEY_DISP_WAIT, disp_wait.Get());
     }
 
-    virtual void Task()
+    // StateHash() plus what it leaves out that still steers execution: the RNG, by its next
+    // output, and what the machine is suspended on. Also O(1).
+    uint64_t ExecutionHash() const
     {
-        Machine::Task();
+        using namespace ::StateHash;
+
+        auto next = rng;
+        return StateHash() ^ Word(KEY_RNG, next()) ^ Word(KEY_WAIT, uint64_t(waiting));
+    }
+
+    // Recomputes the state hash from scratch, to validate StateHash()
+    uint64_t FullStateHash() const
+    {
+        CHIP8State s;
+        SaveState(s);
+        return s.Hash();
+    }
+
+    // Compares the guest visible state: registers, stack and RAM
+    bool SameState(const CHIP8Core & o) const
+    {
+        return PC == o.PC && I == o.I && stack == o.stack
+            && std::equal(V.begin(), V.end(), o.V.begin(), [](auto a, auto b) { return uint8_t(a) == uint8_t(b); })
+            && std::equal(ram.begin(), ram.end(), o.ram.begin());
+    }
+
+    typename tBackend::InputType & GetInput() { return input; };
+    uint8_t GetSoundTimer() const { return audio.Get(); };
+    uint8_t GetDelayTimer() const { return delay.Get(); };
+    uint8_t GetV(std::size_t x) const { return V[x & 0xf]; };
+    uint16_t GetI() const { return I; };
+    const MemorySpecs & GetRam() const { return ram; };
+
+    // The reason the machine is suspended, Wait::None if it is not. Hosts can skip or sleep
+    // through frames until the next timer tick or key change.
+    Wait GetWait() const { return waiting; };
+
+    // Whether Task() can not make progress until a timer tick or a key change. Loops stepping
+    // the machine towards an instruction count stop on it.
+    bool Suspended() { return waiting != Wait::None && Blocked(); };
+
+    uint64_t GetSuspended() const { return suspended; };
+
+    // The statistics counters are not part of the state; hosts that roll frames back put them back
+    void SetCounters(uint64_t r, uint64_t s) { retired = r; suspended = s; };
+
+    void Task()
+    {
+        if (fatal)
+            return;
+
+        // Within a budget a blocked machine stays put; without one it spins on the instruction
+        if (waiting != Wait::None)
+        {
+            if (Blocked() && limit != std::numeric_limits<uint64_t>::max())
+                return;
+            waiting = Wait::None;
+        }
+
+        const uint64_t addr = PC;
+        auto d = Lookup(addr);
+        if (!d)
+        {
+            // Out of range or unknown opcode, let the generic path report it
+            Base::Task();
+            return;
+        }
+
+        ++dispatches;
+
+        auto kind = d->kind;
+        if (d->count > 1 && retired + d->count > limit)
+            kind = Decoded::Kind::Single;
+
+        const auto before = retired;
+
+        switch (kind)
+        {
+        case Decoded::Kind::Single:
+        {
+            PC += 2;
+            auto fn = (d->count > 1) ? Decode(d->op[0]) : d->fn;
+            (*fn)(d->op[0]);
+            ++retired;
+            break;
+        }
+        case Decoded::Kind::LoadRun:
+            for (auto i=0; i<d->count; ++i)
+            {
+                CHIP8OpParse op(d->op[i]);
+                Instructions::AssignV<uint8_t, uint8_t>(&V[op.X], op.NN);
+            }
+            PC += 2 * d->count;
+            retired += d->count;
+            break;
+        case Decoded::Kind::LoadIDraw:
+        {
+            Instructions::AssignV<uint16_t, uint16_t>(&I, d->op[0] & 0x0fff);
+            PC += 4;
+            (*d->fn)(d->op[1]);
+            retired += 2;
+            break;
+        }
+        case Decoded::Kind::TimerPoll:
+        {
+            CHIP8OpParse poll(d->op[0]), test(d->op[1]);
+            Instructions::AssignV<uint8_t, uint8_t>(&V[poll.X], delay.Get());
+            if (V[test.X] == test.NN)
+            {
+                PC += 6;
+                retired += 2;
+            }
+            else
+            {
+                Instructions::AssignV<uint64_t, uint16_t>(&PC, addr);
+                retired += 3;
+            }
+            break;
+        }
+        case Decoded::Kind::CountLoop:
+        {
+            CHIP8OpParse add(d->op[0]), test(d->op[1]);
+            Instructions::AddV<uint8_t, uint8_t>(&V[add.X], add.NN, nullptr);
+            PC += 4;
+            Instructions::SkipNext(&PC, (V[test.X] == test.NN));
+            retired += 2;
+            break;
+        }
+        case Decoded::Kind::Empty:
+            break;
+        }
+
+        if (coverage)
+            for (auto a = addr; a < addr + 2 * (retired - before); a += 2)
+                coverage->set(a);
+
         // auto vram = ram.begin();
         // std::advance(vram, MEMORY_VIDEO);
         // display.Draw(vram, ram.end());
     };
-};
\ No newline at end of file
+};
@@ -0,0 +1,261 @@
+#pragma once
+
+#include <array>
+#include <bitset>
+#include <cstdint>
+#include <cstddef>
+#include <optional>
+#include <algorithm>
+#include <functional>
+
+#include "hash.h"
+
+// Guest memory split in fixed size pages.
+//
+// Every page has an entry on a small page table:
+//  - a direct pointer, used by the fetch stage to read opcodes without any call;
+//  - a dirty bit, set on every write and cleared by whoever consumes it (snapshots, reset);
+//  - a write generation, bumped on every write and never cleared (code caches compare it);
+//  - optional MMIO callbacks. A page with a read hook has no direct pointer.
+//
+// A hash of the contents (see hash.h) is kept up to date on every write.
+//
+// Addresses are wrapped to the memory size, so bulk helpers never run past the end of the
+// backing store no matter what the guest puts in I.
+template <std::size_t SIZE, std::size_t PAGE_SIZE = 256>
+class Memory
+{
+    static_assert((SIZE & (SIZE - 1)) == 0, "Memory size must be a power of 2");
+    static_assert((PAGE_SIZE & (PAGE_SIZE - 1)) == 0, "Page size must be a power of 2");
+    static_assert(SIZE % PAGE_SIZE == 0, "Memory size must be a multiple of page size");
+
+public:
+    static constexpr std::size_t Size = SIZE;
+    static constexpr std::size_t PageSize = PAGE_SIZE;
+    static constexpr std::size_t Pages = SIZE / PAGE_SIZE;
+    static constexpr uint64_t AddrMask = SIZE - 1;
+
+    typedef std::function<uint8_t(uint64_t)> ReadHook;
+    typedef std::function<void(uint64_t, uint8_t)> WriteHook;
+
+    struct MMIO
+    {
+        ReadHook read;                          // Replaces the backing store on reads
+        WriteHook write;                        // Called after the backing store is updated
+    };
+
+protected:
+    std::array<uint8_t, SIZE> data;
+    std::array<uint8_t *, Pages> table;         // nullptr = no direct access (MMIO read hook)
+    std::array<uint32_t, Pages> generation;
+    std::bitset<Pages> dirty;
+    std::array<MMIO, Pages> mmio;
+    std::bitset<Pages> has_mmio;
+    uint64_t hash;
+
+    static constexpr std::size_t PageOf(uint64_t addr) { return (addr & AddrMask) / PAGE_SIZE; };
+
+    void Touch(std::size_t page)
+    {
+        dirty[page] = true;
+        ++generation[page];
+    };
+
+    void Store(uint64_t addr, uint8_t byte)
+    {
+        hash ^= StateHash::Byte(addr, data[addr]) ^ StateHash::Byte(addr, byte);
+        data[addr] = byte;
+    };
+
+    void Rebuild()
+    {
+        for (std::size_t p=0; p<Pages; ++p)
+            table[p] = (has_mmio[p] && mmio[p].read) ? nullptr : data.data() + p * PAGE_SIZE;
+    };
+
+public:
+    Memory() : data{}, table{}, generation{}, dirty{}, mmio{}, has_mmio{}, hash{0}
+    {
+        hash = FullHash();
+        Rebuild();
+    };
+
+    Memory(const Memory & other) : data{other.data}, table{}, generation{other.generation}, dirty{other.dirty}, mmio{other.mmio}, has_mmio{other.has_mmio}, hash{other.hash}
+    {
+        Rebuild();
+    };
+
+    Memory& operator=(const Memory & other)
+    {
+        data = other.data;
+        generation = other.generation;
+        dirty = other.dirty;
+        mmio = other.mmio;
+        has_mmio = other.has_mmio;
+        hash = other.hash;
+        Rebuild();
+        return *this;
+    };
+
+    constexpr std::size_t size() const { return SIZE; };
+
+    // Raw read-only access, e.g. for presenting the video area
+    const uint8_t * begin() const { return data.data(); };
+    const uint8_t * end() const { return data.data() + SIZE; };
+
+    // Direct pointer for the fetch stage. Returns nullptr when the address is out of range
+    // or the page is backed by a MMIO read hook.
+    const uint8_t * FetchPtr(uint64_t addr) const
+    {
+        if (addr >= SIZE)
+            return nullptr;
+        auto page = table[addr / PAGE_SIZE];
+        return page ? page + (addr % PAGE_SIZE) : nullptr;
+    };
+
+    // Checked accessors: out of range addresses fail instead of wrapping
+    std::optional<uint8_t> ReadChecked(uint64_t addr) const
+    {
+        if (addr >= SIZE)
+            return std::nullopt;
+        return Read(addr);
+    };
+
+    bool WriteChecked(uint64_t addr, uint8_t byte)
+    {
+        if (addr >= SIZE)
+            return false;
+        Write(addr, byte);
+        return true;
+    };
+
+    // Wrapping accessors, used by the instructions
+    uint8_t Read(uint64_t addr) const
+    {
+        addr &= AddrMask;
+        auto page = table[addr / PAGE_SIZE];
+        if (page)
+            return page[addr % PAGE_SIZE];
+        return mmio[addr / PAGE_SIZE].read(addr);
+    };
+
+    void Write(uint64_t addr, uint8_t byte)
+    {
+        addr &= AddrMask;
+        const auto page = addr / PAGE_SIZE;
+        Store(addr, byte);
+        Touch(page);
+        if (has_mmio[page] && mmio[page].write)
+            mmio[page].write(addr, byte);
+    };
+
+    // Bulk helpers. They wrap around the end of memory and touch each page only once per run.
+    template <class InputIt>
+    void CopyIn(uint64_t addr, InputIt first, InputIt last)
+    {
+        addr &= AddrMask;
+        while (first != last)
+        {
+            const auto page = addr / PAGE_SIZE;
+            const auto page_end = (page + 1) * PAGE_SIZE;
+            const bool hooked = has_mmio[page] && mmio[page].write;
+            for (; first != last && addr < page_end; ++first, ++addr)
+            {
+                Store(addr, static_cast<uint8_t>(*first));
+                if (hooked)
+                    mmio[page].write(addr, data[addr]);
+            }
+            Touch(page);
+            addr &= AddrMask;
+        }
+    };
+
+    // Like CopyIn, but only the bytes that differ are written, and pages where none does keep
+    // their dirty bit and generation. For restoring states close to the current one; pages are
+    // compared whole first, so an unchanged page costs a memcmp.
+    template <class RandomIt>
+    void Update(uint64_t addr, RandomIt first, RandomIt last)
+    {
+        addr &= AddrMask;
+        while (first != last)
+        {
+            const auto page = addr / PAGE_SIZE;
+            const auto count = std::min<std::size_t>((page + 1) * PAGE_SIZE - addr, last - first);
+            if (!std::equal(first, first + count, data.begin() + addr))
+            {
+                const bool hooked = has_mmio[page] && mmio[page].write;
+                for (std::size_t i=0; i<count; ++i)
+                {
+                    const auto byte = static_cast<uint8_t>(first[i]);
+                    if (byte == data[addr + i])
+                        continue;
+                    Store(addr + i, byte);
+                    if (hooked)
+                        mmio[page].write(addr + i, byte);
+                }
+                Touch(page);
+            }
+            first += count;
+            addr = (addr + count) & AddrMask;
+        }
+    };
+
+    template <class OutputIt>
+    OutputIt CopyOut(uint64_t addr, std::size_t count, OutputIt out) const
+    {
+        for (std::size_t i=0; i<count; ++i)
+            *out++ = Read(addr + i);
+        return out;
+    };
+
+    void Fill(uint64_t addr, std::size_t count, uint8_t byte)
+    {
+        addr &= AddrMask;
+        while (count)
+        {
+            const auto page = addr / PAGE_SIZE;
+            const auto run = std::min<std::size_t>(count, (page + 1) * PAGE_SIZE - addr);
+            for (std::size_t i=0; i<run; ++i)
+                Store(addr + i, byte);
+            Touch(page);
+            if (has_mmio[page] && mmio[page].write)
+                for (std::size_t i=0; i<run; ++i)
+                    mmio[page].write(addr + i, byte);
+            count -= run;
+            addr = (addr + run) & AddrMask;
+        }
+    };
+
+    // MMIO
+    void Map(uint64_t first, uint64_t last, const MMIO & io)
+    {
+        for (auto p = PageOf(first); p <= PageOf(last); ++p)
+        {
+            mmio[p] = io;
+            has_mmio[p] = io.read || io.write;
+        }
+        Rebuild();
+    };
+
+    void Unmap(uint64_t first, uint64_t last) { Map(first, last, MMIO{}); };
+
+    // Write tracking
+    const std::bitset<Pages> & Dirty() const { return dirty; };
+    bool IsDirty(std::size_t page) const { return dirty[page]; };
+    void ClearDirty() { dirty.reset(); };
+    void ClearDirty(std::size_t page) { dirty[page] = false; };
+
+    // Incrementally maintained hash of the contents, and the full recompute it must match
+    uint64_t Hash() const { return hash; };
+
+    uint64_t FullHash() const
+    {
+        uint64_t h = 0;
+        for (std::size_t a=0; a<SIZE; ++a)
+            h ^= StateHash::Byte(a, data[a]);
+        return h;
+    };
+
+    uint32_t Generation(uint64_t addr) const { return generation[PageOf(addr)]; };
+    static constexpr std::size_t Page(uint64_t addr) { return PageOf(addr); };
+};
@@ -0,0 +1,161 @@
+#pragma once
+
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <cstdint>
+#include <fstream>
+#include <algorithm>
+#include <condition_variable>
+
+// Runtime metrics of a front end session. Producers only do relaxed atomic adds and stores, once
+// per frame or event, so collecting costs nothing measurable; readers take snapshots and turn
+// the difference between two of them into rates.
+namespace Metrics
+{
+
+struct Counters
+{
+    std::atomic<uint64_t> instructions{0};      // Retired by the machine
+    std::atomic<uint64_t> frames{0};            // Emulated
+    std::atomic<uint64_t> presented{0};         // Shown by the display
+    std::atomic<uint64_t> emulation_ns{0};      // Spent running frames
+    std::atomic<int64_t> drift_us{0};           // Last frame start against the 60hz schedule, late > 0
+    std::atomic<uint64_t> underruns{0};         // Audio callbacks that came late
+    std::atomic<uint64_t> inputs{0};            // Key presses
+    std::atomic<uint64_t> input_latency_us{0};  // Sum, from the key event to the end of the frame that saw it
+
+    static void Add(std::atomic<uint64_t> & c, uint64_t v) { c.fetch_add(v, std::memory_order_relaxed); };
+    static void Set(std::atomic<uint64_t> & c, uint64_t v) { c.store(v, std::memory_order_relaxed); };
+    static void Set(std::atomic<int64_t> & c, int64_t v) { c.store(v, std::memory_order_relaxed); };
+};
+
+struct Snapshot
+{
+    std::chrono::steady_clock::time_point time;
+    uint64_t instructions;
+    uint64_t frames;
+    uint64_t presented;
+    uint64_t emulation_ns;
+    int64_t drift_us;
+    uint64_t underruns;
+    uint64_t inputs;
+    uint64_t input_latency_us;
+
+    static Snapshot Take(const Counters & c)
+    {
+        auto get = [](const auto & a) { return a.load(std::memory_order_relaxed); };
+        return Snapshot{ std::chrono::steady_clock::now(), get(c.instructions), get(c.frames), get(c.presented), get(c.emulation_ns),
+                         get(c.drift_us), get(c.underruns), get(c.inputs), get(c.input_latency_us) };
+    }
+};
+
+// Over the interval between two snapshots
+struct Rates
+{
+    double ips;
+    double fps;                                 // Presented
+    double emulation_ms;                        // Per emulated frame
+    double drift_ms;
+    uint64_t underruns;
+    double input_latency_ms;                    // Average of the presses in the interval
+
+    static Rates Between(const Snapshot & a, const Snapshot & b)
+    {
+        const double s = std::max(std::chrono::duration<double>(b.time - a.time).count(), 1e-9);
+        const auto frames = b.frames - a.frames;
+        const auto inputs = b.inputs - a.inputs;
+        return Rates{ (b.instructions - a.instructions) / s, (b.presented - a.presented) / s,
+                      frames ? (b.emulation_ns - a.emulation_ns) / 1e6 / frames : 0.0, b.drift_us / 1e3,
+                      b.underruns - a.underruns, inputs ? double(b.input_latency_us - a.input_latency_us) / 1e3 / inputs : 0.0 };
+    }
+};
+
+// Prometheus text exposition format, for the node exporter textfile collector
+inline void WritePrometheus(std::ostream & os, const Snapshot & s, const Rates & r)
+{
+    os << "# TYPE chip8_instructions_total counter\nchip8_instructions_total " << s.instructions << "\n"
+       << "# TYPE chip8_frames_total counter\nchip8_frames_total " << s.frames << "\n"
+       << "# TYPE chip8_presented_frames_total counter\nchip8_presented_frames_total " << s.presented << "\n"
+       << "# TYPE chip8_audio_underruns_total counter\nchip8_audio_underruns_total " << s.underruns << "\n"
+       << "# TYPE chip8_ips gauge\nchip8_ips " << r.ips << "\n"
+       << "# TYPE chip8_fps gauge\nchip8_fps " << r.fps << "\n"
+       << "# TYPE chip8_emulation_seconds_per_frame gauge\nchip8_emulation_seconds_per_frame " << r.emulation_ms / 1e3 << "\n"
+       << "# TYPE chip8_timer_drift_seconds gauge\nchip8_timer_drift_seconds " << r.drift_ms / 1e3 << "\n"
+       << "# TYPE chip8_input_latency_seconds gauge\nchip8_input_latency_seconds " << r.input_latency_ms / 1e3 << "\n";
+}
+
+inline void WriteJSON(std::ostream & os, const Snapshot & s, const Rates & r)
+{
+    os << "{\"instructions\":" << s.instructions << ",\"frames\":" << s.frames << ",\"presented\":" << s.presented
+       << ",\"audio_underruns\":" << s.underruns << ",\"ips\":" << r.ips << ",\"fps\":" << r.fps
+       << ",\"emulation_ms_per_frame\":" << r.emulation_ms << ",\"timer_drift_ms\":" << r.drift_ms
+       << ",\"input_latency_ms\":" << r.input_latency_ms << "}\n";
+}
+
+// Rewrites a file with the counters every few seconds, from its own thread. The file is replaced
+// atomically; it is JSON if its name ends in .json, Prometheus text otherwise.
+class File
+{
+protected:
+    const Counters & counters;
+    std::string path;
+    std::chrono::milliseconds interval;
+    std::mutex lock;
+    std::condition_variable cv;
+    bool closing;
+    std::thread writer;
+
+    bool Write(const Snapshot & s, const Rates & r)
+    {
+        const auto tmp = path + ".tmp";
+        {
+            std::ofstream os(tmp, std::ios::out | std::ios::trunc);
+            if (!os.is_open())
+                return false;
+
+            if (path.size() >= 5 && path.compare(path.size() - 5, 5, ".json") == 0)
+                WriteJSON(os, s, r);
+            else
+                WritePrometheus(os, s, r);
+            if (!os)
+                return false;
+        }
+        return std::rename(tmp.c_str(), path.c_str()) == 0;
+    }
+
+    void Loop()
+    {
+        auto last = Snapshot::Take(counters);
+        std::unique_lock<std::mutex> guard(lock);
+        while (!closing)
+        {
+            cv.wait_for(guard, interval, [this]() { return closing; });
+            const auto now = Snapshot::Take(counters);
+            Write(now, Rates::Between(last, now));
+            last = now;
+        }
+    }
+
+public:
+    File(const Counters & c, const std::string & p, std::chrono::milliseconds every) : counters{c}, path{p}, interval{every}, closing{false}
+    {
+        writer = std::thread(&File::Loop, this);
+    }
+
+    // Writes once more on the way out
+    ~File()
+    {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            closing = true;
+        }
+        cv.notify_all();
+        writer.join();
+    }
+};
+
+}
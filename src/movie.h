@@ -0,0 +1,84 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <fstream>
+#include <algorithm>
+
+#include "hash.h"
+
+// Input movie: everything needed to replay a session bit for bit on a frame locked machine.
+//
+// File layout (integers little endian):
+//   "C8MV" | version u8 | seed u32 | ipf u32 | ROM hash u64 | frame count u32
+//   per frame: key mask u16 | framebuffer hash u64 (after the frame ran)
+struct Movie
+{
+    static constexpr char MAGIC[4] = { 'C', '8', 'M', 'V' };
+    static constexpr uint8_t VERSION = 1;
+
+    struct Frame
+    {
+        uint16_t keys;
+        uint64_t video_hash;
+    };
+
+    uint32_t seed = 12345;
+    uint32_t ipf = 12;                          // 0 = COSMAC VIP timing (see vip.h)
+    uint64_t rom_hash = 0;
+    std::vector<Frame> frames;
+
+    static uint64_t Hash(const uint8_t * p, std::size_t size) { return StateHash::Buffer(p, size); };
+
+    bool Save(const std::string & file) const
+    {
+        std::ofstream os(file, std::ios::out | std::ios::binary | std::ios::trunc);
+        if (!os.is_open())
+            return false;
+
+        auto put = [&os](uint64_t v, int bytes) { for (int b=0; b<bytes; ++b) os.put(char(v >> (8 * b))); };
+
+        os.write(MAGIC, sizeof(MAGIC));
+        put(VERSION, 1);
+        put(seed, 4);
+        put(ipf, 4);
+        put(rom_hash, 8);
+        put(frames.size(), 4);
+        for (auto & f : frames)
+        {
+            put(f.keys, 2);
+            put(f.video_hash, 8);
+        }
+        return bool(os);
+    }
+
+    bool Load(const std::string & file)
+    {
+        std::ifstream is(file, std::ios::in | std::ios::binary);
+        if (!is.is_open())
+            return false;
+
+        auto get = [&is](int bytes) { uint64_t v = 0; for (int b=0; b<bytes; ++b) v |= uint64_t(uint8_t(is.get())) << (8 * b); return v; };
+
+        char magic[sizeof(MAGIC)];
+        if (!is.read(magic, sizeof(magic)) || !std::equal(magic, magic + sizeof(magic), MAGIC) || get(1) != VERSION)
+            return false;
+
+        seed = get(4);
+        ipf = get(4);
+        rom_hash = get(8);
+        const auto count = get(4);
+
+        // Grown as read, a corrupt count only costs what the file really holds
+        frames.clear();
+        for (uint64_t i=0; i<count && is; ++i)
+        {
+            Frame f;
+            f.keys = get(2);
+            f.video_hash = get(8);
+            frames.push_back(f);
+        }
+        return bool(is);
+    }
+};
@@ -0,0 +1,270 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include <cstring>
+
+#include "hash.h"
+#include "state.h"
+
+// CHIP8State with its RAM replaced by the IDs of its pages in a PageStore
+struct PagedState
+{
+    static constexpr std::size_t PAGE_SIZE = 256;
+    static constexpr std::size_t PAGES = 4096 / PAGE_SIZE;
+
+    std::array<uint32_t, PAGES> pages;
+    std::array<uint8_t, 16> V;
+    uint16_t I;
+    uint16_t PC;
+    uint8_t delay;
+    uint8_t sound;
+    uint8_t disp_wait;
+    std::minstd_rand rng;
+    std::vector<uint16_t> stack;
+};
+
+// Content addressed store of RAM pages, shared by any number of threads. Identical pages are
+// kept once and handed out by ID, so snapshots of states that differ in a few bytes share
+// nearly all their memory.
+//
+// The index is a fixed size open addressing table; inserts claim slots with a CAS and never
+// lock. Every page has a reference count, and the slot of a page whose count drops to zero is
+// turned into a tombstone that the next insert probing past it reuses. The count shares a word
+// with the generation of the slot, which the reclaim bumps: an Intern that matched the old
+// contents fails its CAS on the count instead of reviving a freed slot. Probing stops after
+// MAX_PROBE slots, so a nearly full store fails inserts early rather than scanning the table.
+class PageStore
+{
+public:
+    typedef uint32_t PageId;
+    static constexpr std::size_t PAGE_SIZE = PagedState::PAGE_SIZE;
+    static constexpr PageId NONE = 0xffffffff;
+
+protected:
+    static constexpr std::size_t CHUNK = 4096;  // Pages allocated together
+    static constexpr std::size_t MAX_PROBE = 256;
+    static constexpr uint64_t EMPTY = 0;        // Never used, ends a probe
+    static constexpr uint64_t TOMBSTONE = 2;    // Freed, reusable; page hashes are odd
+
+    typedef std::array<uint8_t, PAGE_SIZE> Page;
+
+    struct Slot
+    {
+        std::atomic<uint64_t> hash{EMPTY};      // Claimed by the first inserter
+        std::atomic<uint64_t> refs{0};          // Generation << 32 | count
+        std::atomic<bool> ready{false};         // Contents written
+    };
+
+    static uint32_t Count(uint64_t refs) { return uint32_t(refs); };
+
+    std::size_t mask;
+    std::unique_ptr<Slot[]> slots;
+    std::unique_ptr<std::atomic<Page *>[]> chunks;
+    std::atomic<uint64_t> interned{0};          // References handed out
+    std::atomic<uint64_t> unique{0};            // Pages stored
+    std::atomic<uint64_t> live{0};              // Pages referenced
+    std::atomic<uint64_t> recycled{0};          // Slots freed for reuse
+
+    Page * Chunk(std::size_t c)
+    {
+        auto p = chunks[c].load(std::memory_order_acquire);
+        if (p)
+            return p;
+
+        auto fresh = new Page[CHUNK];
+        if (chunks[c].compare_exchange_strong(p, fresh, std::memory_order_acq_rel))
+            return fresh;
+        delete[] fresh;
+        return p;
+    }
+
+    // Takes a reference on a slot holding `page`, false if it holds something else or is freed
+    bool Match(PageId id, uint64_t hash, const uint8_t * page)
+    {
+        auto & s = slots[id];
+        while (!s.ready.load(std::memory_order_acquire))
+        {
+            if (s.hash.load(std::memory_order_acquire) != hash)
+                return false;
+            std::this_thread::yield();
+        }
+
+        auto refs = s.refs.load(std::memory_order_acquire);
+        if (Count(refs) == 0 || s.hash.load(std::memory_order_acquire) != hash || std::memcmp(Get(id), page, PAGE_SIZE) != 0)
+            return false;
+
+        // Fails if the slot was freed, and maybe reused, since `refs` was read
+        const auto generation = refs >> 32;
+        while (Count(refs) != 0 && refs >> 32 == generation)
+            if (s.refs.compare_exchange_weak(refs, refs + 1, std::memory_order_acq_rel))
+            {
+                ++interned;
+                return true;
+            }
+        return false;
+    }
+
+    // Writes `page` into a slot this thread claimed
+    PageId Fill(PageId id, const uint8_t * page)
+    {
+        auto & s = slots[id];
+        std::memcpy(Chunk(id / CHUNK)[id % CHUNK].data(), page, PAGE_SIZE);
+        s.refs.fetch_add(1, std::memory_order_release);
+        s.ready.store(true, std::memory_order_release);
+        ++unique;
+        ++live;
+        ++interned;
+        return id;
+    }
+
+public:
+    // Room for at least `capacity` distinct pages
+    PageStore(std::size_t capacity = 1 << 20)
+    {
+        std::size_t size = CHUNK;
+        while (size < capacity)
+            size <<= 1;
+        mask = size - 1;
+        slots = std::make_unique<Slot[]>(size);
+        chunks = std::make_unique<std::atomic<Page *>[]>(size / CHUNK);
+        for (std::size_t c=0; c<size / CHUNK; ++c)
+            chunks[c] = nullptr;
+    }
+
+    ~PageStore()
+    {
+        for (std::size_t c=0; c<(mask + 1) / CHUNK; ++c)
+            delete[] chunks[c].load();
+    }
+
+    PageStore(const PageStore &) = delete;
+    PageStore& operator=(const PageStore &) = delete;
+
+    // Returns the page ID with one more reference, NONE when the store is full
+    PageId Intern(const uint8_t * page)
+    {
+        const uint64_t hash = StateHash::Block(page, PAGE_SIZE) | 1;
+        PageId reuse = NONE;                    // First tombstone on the way
+        const auto probes = std::min(MAX_PROBE, mask + 1);
+        for (std::size_t probe=0; probe<probes; ++probe)
+        {
+            const PageId id = (hash + probe) & mask;
+            auto & s = slots[id];
+
+            auto current = s.hash.load(std::memory_order_acquire);
+            if (current == EMPTY)
+            {
+                if (reuse != NONE)
+                    break;
+                if (s.hash.compare_exchange_strong(current, hash, std::memory_order_acq_rel))
+                    return Fill(id, page);
+                // Somebody else claimed it first; current holds their hash
+            }
+
+            if (current == TOMBSTONE)
+            {
+                if (reuse == NONE)
+                    reuse = id;
+                continue;
+            }
+
+            if (current == hash && Match(id, hash, page))
+                return id;
+        }
+
+        // Not stored anywhere on the probe: take the first tombstone, which may have been
+        // reused meanwhile, in which case the page is at worst stored twice
+        if (reuse != NONE)
+        {
+            auto tombstone = TOMBSTONE;
+            if (slots[reuse].hash.compare_exchange_strong(tombstone, hash, std::memory_order_acq_rel))
+                return Fill(reuse, page);
+            if (tombstone == hash && Match(reuse, hash, page))
+                return reuse;
+        }
+        return NONE;
+    }
+
+    // The last reference frees the slot: new generation, then tombstone for inserts to reuse
+    void Release(PageId id)
+    {
+        auto & s = slots[id];
+        const auto refs = s.refs.fetch_sub(1, std::memory_order_acq_rel);
+        if (Count(refs) != 1)
+            return;
+
+        s.ready.store(false, std::memory_order_relaxed);
+        s.refs.store((refs & ~uint64_t(0xffffffff)) + (uint64_t(1) << 32), std::memory_order_release);
+        s.hash.store(TOMBSTONE, std::memory_order_release);
+        --live;
+        ++recycled;
+    }
+
+    const uint8_t * Get(PageId id) const
+    {
+        return chunks[id / CHUNK].load(std::memory_order_acquire)[id % CHUNK].data();
+    }
+
+    // False when the store is full, leaving `out` empty
+    bool Store(const CHIP8State & s, PagedState & out)
+    {
+        for (std::size_t p=0; p<PagedState::PAGES; ++p)
+        {
+            out.pages[p] = Intern(s.ram.data() + p * PAGE_SIZE);
+            if (out.pages[p] == NONE)
+            {
+                while (p--)
+                    Release(out.pages[p]);
+                return false;
+            }
+        }
+
+        out.V = s.V;
+        out.I = s.I;
+        out.PC = s.PC;
+        out.delay = s.delay;
+        out.sound = s.sound;
+        out.disp_wait = s.disp_wait;
+        out.rng = s.rng;
+        out.stack = s.stack;
+        return true;
+    }
+
+    void Restore(const PagedState & s, CHIP8State & out) const
+    {
+        for (std::size_t p=0; p<PagedState::PAGES; ++p)
+            std::memcpy(out.ram.data() + p * PAGE_SIZE, Get(s.pages[p]), PAGE_SIZE);
+
+        out.V = s.V;
+        out.I = s.I;
+        out.PC = s.PC;
+        out.delay = s.delay;
+        out.sound = s.sound;
+        out.disp_wait = s.disp_wait;
+        out.rng = s.rng;
+        out.stack = s.stack;
+    }
+
+    // Drops the references of a stored state
+    void Release(const PagedState & s)
+    {
+        for (auto id : s.pages)
+            Release(id);
+    }
+
+    uint64_t GetInterned() const { return interned; };
+    uint64_t GetUnique() const { return unique; };
+    uint64_t GetLive() const { return live; };
+    uint64_t GetRecycled() const { return recycled; };
+    std::size_t GetCapacity() const { return mask + 1; };
+
+    // References handed out per page actually stored
+    double DedupRatio() const { return unique ? double(interned) / unique : 0.0; };
+};
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <mutex>
+#include <memory>
+#include <vector>
+#include <cstdint>
+
+#include "state.h"
+
+// Pre-constructed machines running the same ROM, for workloads made of many short episodes.
+// Construction (handler tables, decode caches) is paid once. A released machine gets a complete
+// reset that only restores the RAM pages its episode wrote (see CHIP8Core::ResetToBaseline), so
+// an acquired machine is always indistinguishable from one that just loaded the ROM.
+template <class tMachine>
+class MachinePool
+{
+protected:
+    std::vector<std::unique_ptr<tMachine>> machines;
+    std::vector<tMachine *> idle;
+    std::mutex lock;
+    CHIP8State boot;                            // Right after construction, to switch ROMs
+    uint64_t resets = 0;
+    uint64_t restored = 0;                      // Pages copied back by the resets
+
+public:
+    MachinePool(std::size_t count)
+    {
+        for (std::size_t i=0; i<count; ++i)
+        {
+            machines.push_back(std::make_unique<tMachine>());
+            idle.push_back(machines.back().get());
+        }
+        if (!machines.empty())
+            machines.front()->SaveState(boot);
+    }
+
+    // Loads a ROM on every machine and makes it the reset baseline. Every machine must be idle.
+    bool LoadROM(const uint8_t * rom, std::size_t size)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if (idle.size() != machines.size())
+            return false;
+
+        for (auto & m : machines)
+        {
+            m->LoadState(boot);
+            m->Reset();
+            if (!m->LoadROM(rom, size))
+                return false;
+            m->SetBaseline();
+        }
+        return true;
+    }
+
+    // nullptr when every machine is in use
+    tMachine * Acquire()
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if (idle.empty())
+            return nullptr;
+
+        auto m = idle.back();
+        idle.pop_back();
+        return m;
+    }
+
+    void Release(tMachine * m)
+    {
+        const auto pages = m->ResetToBaseline();
+
+        std::lock_guard<std::mutex> guard(lock);
+        idle.push_back(m);
+        ++resets;
+        restored += pages;
+    }
+
+    std::size_t Size() const { return machines.size(); };
+    uint64_t GetResets() const { return resets; };
+    uint64_t GetRestoredPages() const { return restored; };
+};
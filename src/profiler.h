@@ -0,0 +1,386 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <ostream>
+#include <iomanip>
+#include <algorithm>
+
+#include <unistd.h>
+#if defined(__linux__)
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+// Host side profiler: where the time of the emulator goes, as opposed to what the guest does
+// (see metrics.h). Regions of the hot paths are wrapped in scoped probes; while the profiler is
+// off a probe is one branch on a flag.
+//
+// Each thread aggregates into its own buffer, which it alone writes, so probes never lock or
+// allocate: the calls, time and counters of every region in the current frame, folded into the
+// session totals and per frame maximums when the frame changes. Frames are counted by the Frame
+// region, so probes of other threads land in the frame that is running when they end. Buffers
+// are linked into a global list with a CAS the first time a thread records. When the kernel
+// allows it, every probe reads the hardware counters of its thread (cycles, instructions, cache
+// and branch misses) through perf_event_open, two read() calls a probe; otherwise only
+// steady_clock times are kept. Dump() prints what a probe costs, since short regions include it.
+//
+// With Enable(true) every thread also keeps its last CAPACITY probes as events, which Trace()
+// writes as Chrome trace events, for chrome://tracing or Perfetto. Totals are inclusive of the
+// regions nested in them. Dump() and Trace() read the buffers unsynchronized: call them once the
+// profiled threads stopped.
+namespace Profiler
+{
+
+enum class Region : uint8_t
+{
+    Frame,                                      // One front end loop iteration
+    Events,                                     // Host event polling
+    Execute,                                    // Running the instructions of a frame
+    Decode,                                     // Decode cache misses
+    GuestDraw,                                  // Instructions::Draw, into video RAM
+    DisplayDraw,                                // DisplaySDL::Render, scaling and filtering a frame
+    Present,                                    // Rendered frame to the window surface and the screen
+    Audio,                                      // Audio device callbacks
+    COUNT
+};
+
+inline const char * Name(Region r)
+{
+    static const char * names[] = { "frame", "events", "execute", "decode", "guest draw", "display draw", "present", "audio" };
+    return names[std::size_t(r)];
+}
+
+const std::size_t REGIONS = std::size_t(Region::COUNT);
+const std::size_t COUNTERS = 4;                 // cycles, instructions, cache misses, branch misses
+const std::size_t CAPACITY = 1 << 16;           // Trace events kept per thread, the latest ones
+
+typedef std::array<uint64_t, COUNTERS> Counters;
+
+struct Totals
+{
+    uint64_t calls = 0;
+    uint64_t ns = 0;
+    Counters counters{};
+};
+
+struct Event
+{
+    uint64_t start_ns;                          // Since Enable()
+    uint64_t duration_ns;
+    Counters counters;
+    Region region;
+};
+
+class ThreadBuffer
+{
+protected:
+    int group = -1;                             // perf_event group leader, -1 without counters
+    std::array<int, COUNTERS> fds{ -1, -1, -1, -1 };
+    std::array<bool, COUNTERS> counting{};
+
+    uint64_t frame = 0;                         // The one `current` is for
+    std::array<Totals, REGIONS> current;
+
+#if defined(__linux__)
+    int Open(uint64_t config, int leader)
+    {
+        perf_event_attr attr{};
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.size = sizeof(attr);
+        attr.config = config;
+        attr.disabled = leader < 0;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP;
+        return int(syscall(SYS_perf_event_open, &attr, 0, -1, leader, 0));
+    }
+#endif
+
+public:
+    std::array<Totals, REGIONS> session;
+    std::array<uint64_t, REGIONS> max_frame_ns{};   // Longest frame total of every region
+    std::unique_ptr<Event[]> events;            // Ring, only when tracing
+    uint64_t written = 0;                       // Events ever recorded into the ring
+    long tid = 0;
+    const char * name = nullptr;
+    ThreadBuffer * next = nullptr;
+
+    explicit ThreadBuffer(bool trace)
+    {
+        if (trace)
+            events.reset(new Event[CAPACITY]);
+#if defined(__linux__)
+        tid = syscall(SYS_gettid);
+        static const uint64_t configs[COUNTERS] = { PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES };
+        group = Open(configs[0], -1);
+        if (group < 0)
+            return;
+        fds[0] = group;
+        counting[0] = true;
+        for (std::size_t c=1; c<COUNTERS; ++c)
+        {
+            fds[c] = Open(configs[c], group);
+            counting[c] = fds[c] >= 0;
+        }
+        ioctl(group, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(group, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+#endif
+    }
+
+    ~ThreadBuffer()
+    {
+        for (auto fd : fds)
+            if (fd >= 0)
+                close(fd);
+    }
+
+    bool HasCounters() const { return group >= 0; };
+    bool Counting(std::size_t c) const { return counting[c]; };
+
+    // Counters of the group in the order they were opened, zeros without counters
+    void Read(Counters & out) const
+    {
+        out.fill(0);
+        if (group < 0)
+            return;
+
+        uint64_t values[1 + COUNTERS] = {};
+        if (read(group, values, sizeof(values)) < ssize_t(sizeof(uint64_t)))
+            return;
+        for (std::size_t c=0, v=1; c<COUNTERS && v<=values[0]; ++c)
+            if (counting[c])
+                out[c] = values[v++];
+    }
+
+    // Adds the current frame to the session
+    void Fold()
+    {
+        for (std::size_t r=0; r<REGIONS; ++r)
+        {
+            auto & s = session[r];
+            const auto & f = current[r];
+            s.calls += f.calls;
+            s.ns += f.ns;
+            for (std::size_t c=0; c<COUNTERS; ++c)
+                s.counters[c] += f.counters[c];
+            max_frame_ns[r] = std::max(max_frame_ns[r], f.ns);
+        }
+        current = {};
+    }
+
+    void Record(uint64_t in_frame, const Event & e)
+    {
+        if (in_frame != frame)
+        {
+            Fold();
+            frame = in_frame;
+        }
+
+        auto & t = current[std::size_t(e.region)];
+        ++t.calls;
+        t.ns += e.duration_ns;
+        for (std::size_t c=0; c<COUNTERS; ++c)
+            t.counters[c] += e.counters[c];
+
+        if (events)
+            events[written++ % CAPACITY] = e;
+    }
+};
+
+inline bool enabled = false;                    // Set before the threads to profile start
+inline bool tracing = false;
+inline std::chrono::steady_clock::time_point epoch;
+inline std::atomic<uint64_t> frames{0};         // Frame regions entered
+inline std::atomic<ThreadBuffer *> threads{nullptr};
+
+// With `trace`, keeps the latest events of every thread for Trace()
+inline void Enable(bool trace = false)
+{
+    epoch = std::chrono::steady_clock::now();
+    tracing = trace;
+    enabled = true;
+}
+
+// Buffer of the calling thread, created and linked on first use
+inline ThreadBuffer * Local()
+{
+    thread_local ThreadBuffer * buffer = nullptr;
+    if (!buffer)
+    {
+        buffer = new ThreadBuffer(tracing);
+        buffer->next = threads.load(std::memory_order_relaxed);
+        while (!threads.compare_exchange_weak(buffer->next, buffer, std::memory_order_release, std::memory_order_relaxed))
+            ;
+    }
+    return buffer;
+}
+
+// Shows in the trace instead of the thread ID
+inline void NameThread(const char * name)
+{
+    if (enabled)
+        Local()->name = name;
+}
+
+inline uint64_t Now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+class Probe
+{
+protected:
+    ThreadBuffer * buffer;
+    Region region;
+    uint64_t start;
+    Counters counters;
+
+public:
+    explicit Probe(Region r) : buffer{enabled ? Local() : nullptr}, region{r}
+    {
+        if (!buffer)
+            return;
+        if (r == Region::Frame)
+            frames.fetch_add(1, std::memory_order_relaxed);
+        buffer->Read(counters);
+        start = Now();
+    }
+
+    ~Probe()
+    {
+        if (!buffer)
+            return;
+
+        const auto end = Now();
+        Counters now;
+        buffer->Read(now);
+        Event e{ start, end - start, {}, region };
+        for (std::size_t c=0; c<COUNTERS; ++c)
+            e.counters[c] = now[c] - counters[c];
+        buffer->Record(frames.load(std::memory_order_relaxed), e);
+    }
+
+    Probe(const Probe &) = delete;
+    Probe& operator=(const Probe &) = delete;
+};
+
+// Per region figures of the whole session. The worst frame of a region is the worst one of the
+// thread it ran on.
+inline void Dump(std::ostream & os)
+{
+    std::array<Totals, REGIONS> totals;
+    std::array<uint64_t, REGIONS> max_frame_ns{};
+    bool counters = false;
+    uint64_t overwritten = 0;
+    for (auto t = threads.load(std::memory_order_acquire); t; t = t->next)
+    {
+        t->Fold();
+        for (std::size_t r=0; r<REGIONS; ++r)
+        {
+            totals[r].calls += t->session[r].calls;
+            totals[r].ns += t->session[r].ns;
+            for (std::size_t c=0; c<COUNTERS; ++c)
+                totals[r].counters[c] += t->session[r].counters[c];
+            max_frame_ns[r] = std::max(max_frame_ns[r], t->max_frame_ns[r]);
+        }
+        counters = counters || t->HasCounters();
+        if (t->events && t->written > CAPACITY)
+            overwritten += t->written - CAPACITY;
+    }
+
+    // What a probe adds to the region around it: the clock and, with counters, two group reads
+    auto local = Local();
+    Counters scratch;
+    const auto calibrate = std::chrono::steady_clock::now();
+    for (auto i=0; i<1000; ++i)
+    {
+        local->Read(scratch);
+        Now();
+        Now();
+        local->Read(scratch);
+    }
+    const double probe_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - calibrate).count() / 1000;
+
+    const auto frame_count = frames.load();
+    const auto count = std::max<uint64_t>(frame_count, 1);
+    os << "Profile: " << frame_count << " frames, " << (counters ? "perf_event counters" : "steady_clock only, no perf_event access")
+       << std::fixed << std::setprecision(2) << ", " << probe_us << "us per probe, included in the regions around it\n";
+    os << std::left << std::setw(14) << "  region" << std::right << std::setw(10) << "calls" << std::setw(12) << "total ms"
+       << std::setw(12) << "ms/frame" << std::setw(12) << "max ms";
+    if (counters)
+        os << std::setw(12) << "Mcycles" << std::setw(8) << "IPC" << std::setw(12) << "cache miss" << std::setw(12) << "branch miss";
+    os << "\n";
+    for (std::size_t r=0; r<REGIONS; ++r)
+    {
+        const auto & t = totals[r];
+        if (!t.calls)
+            continue;
+        os << "  " << std::left << std::setw(12) << Name(Region(r)) << std::right << std::setw(10) << t.calls
+           << std::setprecision(3) << std::setw(12) << t.ns / 1e6 << std::setw(12) << t.ns / 1e6 / count << std::setw(12) << max_frame_ns[r] / 1e6;
+        if (counters)
+            os << std::setprecision(2) << std::setw(12) << t.counters[0] / 1e6 << std::setw(8) << (t.counters[0] ? double(t.counters[1]) / t.counters[0] : 0.0)
+               << std::setw(12) << t.counters[2] << std::setw(12) << t.counters[3];
+        os << "\n";
+    }
+    os << std::defaultfloat;
+    if (overwritten)
+        os << "  trace keeps the last " << CAPACITY << " events of every thread, " << overwritten << " older ones are only in the totals\n";
+}
+
+// Chrome trace event format, one complete ("X") event per probe kept
+inline bool Trace(std::ostream & os)
+{
+    static const char * counter_names[COUNTERS] = { "cycles", "instructions", "cache_misses", "branch_misses" };
+
+    os << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    bool first = true;
+    auto sep = [&]() -> std::ostream & { os << (first ? "" : ",\n"); first = false; return os; };
+    for (auto t = threads.load(std::memory_order_acquire); t; t = t->next)
+    {
+        if (t->name)
+            sep() << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << t->tid << ",\"args\":{\"name\":\"" << t->name << "\"}}";
+        if (!t->events)
+            continue;
+
+        for (auto i = t->written - std::min<uint64_t>(t->written, CAPACITY); i<t->written; ++i)
+        {
+            const auto & e = t->events[i % CAPACITY];
+            sep() << "{\"name\":\"" << Name(e.region) << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << t->tid
+                  << ",\"ts\":" << e.start_ns / 1000 << "." << std::setw(3) << std::setfill('0') << e.start_ns % 1000
+                  << ",\"dur\":" << e.duration_ns / 1000 << "." << std::setw(3) << e.duration_ns % 1000 << std::setfill(' ');
+            if (t->HasCounters())
+            {
+                os << ",\"args\":{";
+                bool first_arg = true;
+                for (std::size_t c=0; c<COUNTERS; ++c)
+                    if (t->Counting(c))
+                    {
+                        os << (first_arg ? "" : ",") << "\"" << counter_names[c] << "\":" << e.counters[c];
+                        first_arg = false;
+                    }
+                os << "}";
+            }
+            os << "}";
+        }
+    }
+    os << "\n]}\n";
+    return bool(os);
+}
+
+}
+
+// Probes inside the emulation core. Only builds that define CHIP8_PROFILER (the front end, see
+// CMakeLists.txt) keep them, so that libchip8 and the tools have no profiler state at all.
+#ifdef CHIP8_PROFILER
+#define CHIP8_PROBE(region) Profiler::Probe probe(Profiler::Region::region)
+#else
+#define CHIP8_PROBE(region)
+#endif
@@ -0,0 +1,256 @@
+#pragma once
+
+#include <array>
+#include <vector>
+#include <cstdint>
+
+#include "state.h"
+#include "stack.h"
+
+// Deliberately simple CHIP-8: one switch, plain bytes, no caches and no templates.
+// It mirrors the semantics of CHIP8Core (including its quirks) and is only meant to check the
+// fast paths against. Opcodes CHIP8Core only runs through a fuzzy match are not modelled; the
+// model stops with Status::Unsupported instead.
+class CHIP8Reference
+{
+public:
+    enum class Status { Running, Halted, Unsupported };
+
+    struct Trace
+    {
+        uint64_t PC;
+        uint16_t op;
+    };
+
+protected:
+    CHIP8State s;
+    uint16_t keys;
+    uint64_t retired;
+    Status status;
+
+    std::vector<Trace> history;                 // Ring buffer of the last instructions
+    std::size_t history_pos;
+
+    uint8_t & Mem(uint64_t addr) { return s.ram[addr & 0xfff]; };
+
+    bool Pressed(uint8_t key) const { return key < 16 && ((keys >> key) & 0x1); };
+
+    void Draw(uint8_t x, uint8_t y, uint8_t n)
+    {
+        uint8_t X = s.V[x] % 64;
+        uint8_t Y = s.V[y] % 32;
+        uint64_t sprite = s.I;
+        uint64_t video = 0xf00 + (Y * 64 + X) / 8;
+        const uint8_t shift = X % 8;
+
+        while (n-- && Y++ < 32)
+        {
+            uint8_t screen = Mem(video) << shift;
+            if (shift)
+                screen |= Mem(video + 1) >> (8 - shift);
+
+            uint8_t xored = screen ^ Mem(sprite);
+
+            uint8_t mask = 0xff;
+            if (X + 8 > 64)
+                mask <<= (8 - (64 - X));
+            screen &= mask;
+            xored &= mask;
+
+            // Collision of the last row wins, like Instructions::Draw
+            s.V[0xf] = (screen & xored) != screen;
+
+            Mem(video) = (Mem(video) & ~(mask >> shift)) | (xored >> shift);
+            if (shift)
+                Mem(video + 1) = (Mem(video + 1) & ~(mask << (8 - shift))) | (xored << (8 - shift));
+
+            sprite += 1;
+            video += 8;
+        }
+    }
+
+public:
+    CHIP8Reference(std::size_t history_size = 32) : s{}, keys{0}, retired{0}, status{Status::Running},
+                                                    history(std::max<std::size_t>(history_size, 1)), history_pos{0}
+    { };
+
+    void Load(const CHIP8State & state)
+    {
+        s = state;
+        status = Status::Running;
+    }
+
+    const CHIP8State & GetState() const { return s; };
+    Status GetStatus() const { return status; };
+    uint64_t GetRetired() const { return retired; };
+    void SetRetired(uint64_t r) { retired = r; };
+    void SetKeys(uint16_t mask) { keys = mask; };
+
+    // Oldest first
+    std::vector<Trace> GetHistory() const
+    {
+        std::vector<Trace> out;
+        for (std::size_t i=0; i<history.size(); ++i)
+        {
+            auto & t = history[(history_pos + i) % history.size()];
+            if (t.op || t.PC)
+                out.push_back(t);
+        }
+        return out;
+    }
+
+    void TickTimers()
+    {
+        if (s.delay) --s.delay;
+        if (s.sound) --s.sound;
+        if (s.disp_wait) --s.disp_wait;
+    }
+
+    void Step()
+    {
+        if (status != Status::Running)
+            return;
+
+        // Fetch, failing the same way the paged memory does at the very end of RAM
+        if (s.PC >= s.ram.size() - 1)
+        {
+            if (s.PC == s.ram.size() - 1)
+                ++s.PC;
+            status = Status::Halted;
+            return;
+        }
+
+        const uint64_t at = s.PC;
+        const uint16_t op = s.ram[s.PC] << 8 | s.ram[s.PC + 1];
+        s.PC += 2;
+
+        history[history_pos] = Trace{ at, op };
+        history_pos = (history_pos + 1) % history.size();
+
+        if (op == 0)
+        {
+            status = Status::Halted;
+            return;
+        }
+
+        const uint16_t NNN = op & 0x0fff;
+        const uint8_t NN = op & 0xff;
+        const uint8_t N = op & 0xf;
+        const uint8_t x = (op >> 8) & 0xf;
+        const uint8_t y = (op >> 4) & 0xf;
+        auto & VX = s.V[x];
+        auto & VY = s.V[y];
+        auto & VF = s.V[0xf];
+
+        switch (op >> 12)
+        {
+        case 0x0:
+            if (op == 0x00e0)
+                std::fill(s.ram.begin() + 0xf00, s.ram.end(), 0);
+            else if (op == 0x00ee && !s.stack.empty())
+            {
+                s.PC = s.stack.back();
+                s.stack.pop_back();
+            }
+            break;
+        case 0x1: s.PC = NNN; break;
+        case 0x2:
+            // Stops on the call like the machine, which still counts it
+            if (s.stack.size() >= CallStack<uint16_t>::DEPTH)
+            {
+                s.PC -= 2;
+                status = Status::Halted;
+                ++retired;
+                return;
+            }
+            s.stack.push_back(s.PC);
+            s.PC = NNN;
+            break;
+        case 0x3: if (VX == NN) s.PC += 2; break;
+        case 0x4: if (VX != NN) s.PC += 2; break;
+        case 0x5: if (N) { status = Status::Unsupported; return; } if (VX == VY) s.PC += 2; break;
+        case 0x9: if (N) { status = Status::Unsupported; return; } if (VX != VY) s.PC += 2; break;
+        case 0x6: VX = NN; break;
+        case 0x7: VX += NN; break;
+        case 0x8:
+            switch (N)
+            {
+            case 0x0: VX = VY; break;
+            case 0x1: VX |= VY; VF = 0; break;
+            case 0x2: VX &= VY; VF = 0; break;
+            case 0x3: VX ^= VY; VF = 0; break;
+            case 0x4:
+                // Adding zero leaves VF alone
+                if (VY) { const bool carry = VX + VY > 0xff; VX += VY; VF = carry; }
+                break;
+            case 0x5:
+                if (VY) { const bool borrow = VX < VY; VX -= VY; VF = !borrow; }
+                break;
+            case 0x6: VX = VY; { const uint8_t lsb = VX & 0x1; VX >>= 1; VF = lsb; } break;
+            case 0x7:
+                if (VY) { const bool borrow = VY < VX; VX = VY - VX; VF = !borrow; }
+                break;
+            case 0xe: VX = VY; { const uint8_t msb = !!(VX & 0x80); VX <<= 1; VF = msb; } break;
+            default: status = Status::Unsupported; return;
+            }
+            break;
+        case 0xa: s.I = NNN; break;
+        case 0xb: s.PC = NNN + s.V[0]; break;
+        case 0xc: VX = uint8_t(s.rng() & 0xff) & NN; break;
+        case 0xd:
+            if (s.disp_wait)
+            {
+                s.PC -= 2;
+                break;
+            }
+            Draw(x, y, N);
+            s.disp_wait = 1;
+            break;
+        case 0xe:
+            // Keys above 0xf map to their low nibble, except 0x10 which is never pressed
+            if (NN == 0x9e) { if (VX != 0x10 && Pressed(VX & 0xf)) s.PC += 2; }
+            else if (NN == 0xa1) { if (!(VX != 0x10 && Pressed(VX & 0xf))) s.PC += 2; }
+            else { status = Status::Unsupported; return; }
+            break;
+        case 0xf:
+            switch (NN)
+            {
+            case 0x07: VX = s.delay; break;
+            case 0x0a:
+            {
+                uint8_t k = 0;
+                while (k < 16 && !Pressed(k))
+                    ++k;
+                if (k == 16)
+                    s.PC -= 2;
+                else
+                    VX = k;
+                break;
+            }
+            case 0x15: s.delay = VX; break;
+            case 0x18: s.sound = VX; break;
+            case 0x1e: s.I += VX; break;
+            case 0x29: s.I = 0x50 + VX * 5; break;
+            case 0x33:
+                Mem(s.I) = VX / 100;
+                Mem(s.I + 1) = (VX / 10) % 10;
+                Mem(s.I + 2) = VX % 10;
+                break;
+            case 0x55:
+                for (auto i=0; i<=x; ++i)
+                    Mem(s.I + i) = s.V[i];
+                s.I += x + 1;
+                break;
+            case 0x65:
+                for (auto i=0; i<=x; ++i)
+                    s.V[i] = Mem(s.I + i);
+                s.I += x + 1;
+                break;
+            default: status = Status::Unsupported; return;
+            }
+            break;
+        }
+
+        ++retired;
+    }
+};
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <cstdint>
+#include <algorithm>
+
+#include "triple.h"
+#include "profiler.h"
+
+// Renders frames on a dedicated thread at the display refresh rate, so that scaling and
+// filtering never stall the interpreter. The emulation thread submits complete video frames
+// through a triple buffer; every refresh renders the latest one with tDisplay::Render(), which
+// hands the pixels over to the thread that owns the window. That thread shows them with
+// Present(), since SDL only supports window calls on the thread that created the window.
+//
+// Only the render thread calls Render() once it started.
+template <class tDisplay, std::size_t VIDEO_SIZE = 256>
+class Renderer
+{
+public:
+    typedef std::array<uint8_t, VIDEO_SIZE> Frame;
+
+    struct Stats
+    {
+        uint64_t submitted;
+        uint64_t rendered;
+        uint64_t presented;
+        uint64_t dropped;                       // Replaced before any refresh rendered them
+        uint64_t duplicated;                    // Refreshes with no new frame to render
+        double draw_avg_ms;                     // Time spent rendering a frame
+        double draw_max_ms;
+        double interval_max_ms;                 // Longest time between two presents
+    };
+
+protected:
+    tDisplay & display;
+    TripleBuffer<Frame> frames;
+    std::chrono::nanoseconds period;
+    std::atomic<bool> stop;
+    uint64_t submitted;                         // Emulation thread only
+    uint64_t presented;
+    std::chrono::nanoseconds interval_max;
+    std::chrono::steady_clock::time_point last;
+    uint64_t rendered;                          // Render thread only, read after join
+    uint64_t duplicated;
+    std::chrono::nanoseconds draw_total;
+    std::chrono::nanoseconds draw_max;
+    std::thread thread;
+
+    void Loop()
+    {
+        typedef std::chrono::steady_clock Clock;
+        Profiler::NameThread("render");
+
+        auto next = Clock::now();
+        while (!stop.load(std::memory_order_relaxed))
+        {
+            if (frames.Update())
+            {
+                const auto & f = frames.Front();
+                const auto start = Clock::now();
+                display.Render(f.data(), f.data() + f.size());
+                const auto end = Clock::now();
+
+                draw_total += end - start;
+                draw_max = std::max<std::chrono::nanoseconds>(draw_max, end - start);
+                ++rendered;
+            }
+            else if (rendered)
+                ++duplicated;
+
+            // Starts over after a stall instead of presenting in a burst to catch up
+            next += period;
+            const auto now = Clock::now();
+            if (next < now)
+                next = now;
+            std::this_thread::sleep_until(next);
+        }
+    }
+
+public:
+    Renderer(tDisplay & d, unsigned int hz) : display{d}, period{std::chrono::nanoseconds(1000000000) / std::max(hz, 1u)}, stop{false},
+                                              submitted{0}, presented{0}, interval_max{0}, last{}, rendered{0}, duplicated{0}, draw_total{0}, draw_max{0}
+    {
+        thread = std::thread(&Renderer::Loop, this);
+    }
+
+    ~Renderer()
+    {
+        Stop();
+    }
+
+    // Never blocks
+    template <class InputIt>
+    void Submit(InputIt first, InputIt last)
+    {
+        auto & f = frames.Back();
+        std::fill(std::copy(first, first + std::min<std::size_t>(last - first, f.size()), f.begin()), f.end(), 0);
+        frames.Publish();
+        ++submitted;
+    }
+
+    // On the thread that owns the window: shows the latest rendered frame, if there is a new one
+    void Present()
+    {
+        if (!display.Show())
+            return;
+
+        const auto now = std::chrono::steady_clock::now();
+        if (presented++)
+            interval_max = std::max<std::chrono::nanoseconds>(interval_max, now - last);
+        last = now;
+    }
+
+    void Stop()
+    {
+        stop = true;
+        if (thread.joinable())
+            thread.join();
+    }
+
+    // Only complete once stopped
+    Stats GetStats() const
+    {
+        typedef std::chrono::duration<double, std::milli> Ms;
+        return Stats{ submitted, rendered, presented, frames.GetDropped(), duplicated,
+                      rendered ? Ms(draw_total).count() / rendered : 0.0, Ms(draw_max).count(), Ms(interval_max).count() };
+    }
+};
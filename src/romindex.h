@@ -0,0 +1,360 @@
+#pragma once
+
+#include <map>
+#include <deque>
+#include <bitset>
+#include <cstdio>
+#include <charconv>
+#include <system_error>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+
+// Static analysis of ROMs, and the index chip8-scan builds from it for the front end.
+//
+// A ROM is disassembled from 0x200 following every branch, so data is never mistaken for
+// code. From the reachable instructions it tells the instruction sets in use, behaviours that
+// interpreters disagree on (quirks) and a speed to run it at. The index is a text file with
+// one ROM per line, keyed by the same hash that names the .kmap files:
+//   <key> <platform> ipf=<N> quirks=<a,b,...|-> reachable=<N> unknown=<N> # <file>
+namespace RomIndex
+{
+
+const unsigned int ENTRY = 0x200;
+const unsigned int MEMORY = 4096;
+
+// Instruction sets
+const uint8_t SET_BASE = 0x1;
+const uint8_t SET_SCHIP = 0x2;                  // 00Cn 00fb-00ff dXY0 fX30 fX75 fX85
+const uint8_t SET_XOCHIP = 0x4;                 // 00Dn 5XY2 5XY3 f000 NNNN fN01 f002 fX3a
+const uint8_t SET_MACHINE_CODE = 0x8;           // 0NNN calls into the host CPU
+
+// Quirks, behaviours the ROM depends on that differ between interpreters
+const uint8_t QUIRK_SHIFT = 0x1;                // 8XY6/8XYe with X != Y: shifts VY on the VIP, VX elsewhere
+const uint8_t QUIRK_JUMP = 0x2;                 // bNNN: V0 + NNN on the VIP, VX + NNN on SCHIP
+const uint8_t QUIRK_MEMORY = 0x4;               // Uses I after fX55/fX65 without reloading it
+const uint8_t QUIRK_SELFMOD = 0x8;              // Points I at its own code and writes memory
+
+// Key map and index key of a ROM, from a hash of its bytes
+inline std::string Key(const std::vector<uint8_t> & rom)
+{
+    std::size_t result = 0;
+    for (auto b : rom)
+        result = result * 31 + b;
+
+    // The loader used to store one byte past the end of the file, a copy of the last one
+    if (!rom.empty())
+        result = result * 31 + rom.back();
+
+    std::string key{std::to_string(result)};
+    while (key.length() > 8)
+        key.pop_back();
+    return key;
+}
+
+struct Entry
+{
+    std::string key;
+    uint8_t sets = 0;
+    uint8_t quirks = 0;
+    unsigned int ipf = 12;                      // Instructions per 60hz frame
+    unsigned int reachable = 0;                 // Instructions
+    unsigned int unknown = 0;                   // Reachable opcodes no instruction set defines
+    std::string file;
+
+    const char * Platform() const
+    {
+        return (sets & SET_XOCHIP) ? "xochip" : (sets & SET_SCHIP) ? "schip" : "chip8";
+    }
+};
+
+inline std::string QuirkNames(uint8_t quirks)
+{
+    static const char * names[] = { "shift", "jump", "memory", "selfmod" };
+    std::string s;
+    for (unsigned int q=0; q<4; ++q)
+        if (quirks & (1 << q))
+            s += (s.empty() ? "" : ",") + std::string(names[q]);
+    return s.empty() ? "-" : s;
+}
+
+class Analyzer
+{
+protected:
+    const std::vector<uint8_t> & rom;
+    std::bitset<MEMORY> reachable;
+    std::vector<uint16_t> targets;              // aNNN
+    bool writes = false;                        // fX33 or fX55 reachable
+    bool timer_wait = false;                    // fX07 reachable
+    Entry entry;
+
+    bool InRom(uint32_t addr) const { return addr >= ENTRY && addr + 1 < ENTRY + rom.size(); };
+    uint16_t OpAt(uint32_t addr) const { return rom[addr - ENTRY] << 8 | rom[addr - ENTRY + 1]; };
+
+    // Instructions are 2 bytes except f000 NNNN, which skips jump over whole
+    unsigned int Length(uint32_t addr) const { return (InRom(addr) && OpAt(addr) == 0xf000) ? 4 : 2; };
+
+    // Sets of an opcode, 0 when nobody defines it
+    static uint8_t Classify(uint16_t op)
+    {
+        const unsigned int X = (op >> 8) & 0xf, N = op & 0xf, NN = op & 0xff;
+        switch (op >> 12)
+        {
+        case 0x0:
+            if (op == 0x00e0 || op == 0x00ee)
+                return SET_BASE;
+            if ((op & 0xfff0) == 0x00c0 || (op >= 0x00fb && op <= 0x00ff))
+                return SET_SCHIP;
+            if ((op & 0xfff0) == 0x00d0)
+                return SET_XOCHIP;
+            return SET_MACHINE_CODE;
+        case 0x5:
+            return N == 0 ? SET_BASE : (N == 2 || N == 3) ? SET_XOCHIP : 0;
+        case 0x8:
+            return (N <= 0x7 || N == 0xe) ? SET_BASE : 0;
+        case 0x9:
+            return N == 0 ? SET_BASE : 0;
+        case 0xd:
+            return N == 0 ? SET_SCHIP : SET_BASE;
+        case 0xe:
+            return (NN == 0x9e || NN == 0xa1) ? SET_BASE : 0;
+        case 0xf:
+            switch (NN)
+            {
+            case 0x07: case 0x0a: case 0x15: case 0x18: case 0x1e: case 0x29: case 0x33: case 0x55: case 0x65:
+                return SET_BASE;
+            case 0x30: case 0x75: case 0x85:
+                return SET_SCHIP;
+            case 0x3a:
+                return SET_XOCHIP;
+            case 0x00:
+                return X == 0 ? SET_XOCHIP : 0;
+            case 0x01:
+                return SET_XOCHIP;
+            case 0x02:
+                return X == 0 ? SET_XOCHIP : 0;
+            }
+            return 0;
+        }
+        return SET_BASE;
+    }
+
+    // Straight line code after fX55/fX65 that uses I before setting it again
+    bool UsesIncrementedI(uint32_t addr) const
+    {
+        for (unsigned int n=0; n<8 && InRom(addr); ++n, addr += 2)
+        {
+            const uint16_t op = OpAt(addr);
+            const unsigned int NN = op & 0xff;
+            if ((op >> 12) == 0xa || ((op >> 12) == 0xf && NN == 0x29))
+                return false;
+            if ((op >> 12) == 0xd || ((op >> 12) == 0xf && (NN == 0x1e || NN == 0x33 || NN == 0x55 || NN == 0x65)))
+                return true;
+            if ((op >> 12) <= 0x5 || (op >> 12) == 0x9 || (op >> 12) == 0xb || (op >> 12) == 0xe)
+                return false;
+        }
+        return false;
+    }
+
+    void Visit(uint32_t addr, std::deque<uint32_t> & work)
+    {
+        const uint16_t op = OpAt(addr);
+        const unsigned int X = (op >> 8) & 0xf, Y = (op >> 4) & 0xf, N = op & 0xf, NN = op & 0xff, NNN = op & 0xfff;
+        const auto sets = Classify(op);
+
+        ++entry.reachable;
+        entry.sets |= sets;
+        if (!sets)
+        {
+            ++entry.unknown;
+            return;
+        }
+
+        const auto next = addr + Length(addr);
+        switch (op >> 12)
+        {
+        case 0x0:
+            if (op == 0x00ee || op == 0x00fd)
+                return;
+            break;
+        case 0x1:
+            work.push_back(NNN);
+            return;
+        case 0x2:
+            work.push_back(NNN);
+            break;
+        case 0x3: case 0x4: case 0x5: case 0x9: case 0xe:
+            if ((op >> 12) != 0x5 || N == 0)
+                work.push_back(next + Length(next));
+            break;
+        case 0x8:
+            if ((N == 0x6 || N == 0xe) && X != Y)
+                entry.quirks |= QUIRK_SHIFT;
+            break;
+        case 0xa:
+            targets.push_back(NNN);
+            break;
+        case 0xb:
+            // Computed: the targets are not known statically
+            entry.quirks |= QUIRK_JUMP;
+            return;
+        case 0xf:
+            if (NN == 0x07)
+                timer_wait = true;
+            if (NN == 0x33 || NN == 0x55)
+                writes = true;
+            if ((NN == 0x55 || NN == 0x65) && UsesIncrementedI(next))
+                entry.quirks |= QUIRK_MEMORY;
+            if (op == 0xf000 && InRom(addr + 2))
+                targets.push_back(OpAt(addr + 2));
+            break;
+        }
+        work.push_back(next);
+    }
+
+public:
+    Analyzer(const std::vector<uint8_t> & image) : rom{image} { };
+
+    // Fills the entry, calling `f(addr, op)` on every reachable instruction in address order
+    template <class tFn>
+    Entry Run(tFn f)
+    {
+        entry.key = Key(rom);
+
+        std::deque<uint32_t> work{ ENTRY };
+        while (!work.empty())
+        {
+            const auto addr = work.front();
+            work.pop_front();
+            if (!InRom(addr) || reachable[addr])
+                continue;
+            reachable[addr] = true;
+            Visit(addr, work);
+        }
+
+        if (writes)
+            for (auto t : targets)
+                for (unsigned int a=t; a<std::min(t + 16u, MEMORY); ++a)
+                    if (reachable[a])
+                        entry.quirks |= QUIRK_SELFMOD;
+
+        // Defaults of the platforms (the VIP ran about 700 instructions a second). ROMs that
+        // pace themselves on the delay timer only need the speed as headroom, so they get more.
+        if (entry.sets & SET_XOCHIP)
+            entry.ipf = 1000;
+        else if (entry.sets & SET_SCHIP)
+            entry.ipf = timer_wait ? 50 : 30;
+        else
+            entry.ipf = timer_wait ? 20 : 12;
+
+        for (unsigned int a=ENTRY; a<MEMORY; ++a)
+            if (reachable[a])
+                f(a, OpAt(a));
+        return entry;
+    }
+
+    Entry Run() { return Run([](unsigned int, uint16_t) { }); };
+};
+
+inline std::ostream & operator<<(std::ostream & os, const Entry & e)
+{
+    os << e.key << " " << e.Platform() << " ipf=" << e.ipf << " quirks=" << QuirkNames(e.quirks)
+       << " reachable=" << e.reachable << " unknown=" << e.unknown;
+    if (!e.file.empty())
+        os << " # " << e.file;
+    return os;
+}
+
+// The whole of `value` as a number; false if it is anything else or out of range
+inline bool ParseNumber(const std::string & value, unsigned int & n)
+{
+    const auto end = value.data() + value.size();
+    const auto r = std::from_chars(value.data(), end, n);
+    return r.ec == std::errc() && r.ptr == end;
+}
+
+// False if the line is not an index entry, including malformed ones; `e` is only set on success
+inline bool Parse(const std::string & line, Entry & out)
+{
+    std::istringstream is(line.substr(0, line.find('#')));
+    std::string platform, field;
+    Entry e;
+    if (!(is >> e.key >> platform))
+        return false;
+
+    e.sets = SET_BASE | (platform == "schip" ? SET_SCHIP : 0) | (platform == "xochip" ? SET_XOCHIP : 0);
+    while (is >> field)
+    {
+        const auto eq = field.find('=');
+        if (eq == std::string::npos)
+            return false;
+        const auto name = field.substr(0, eq), value = field.substr(eq + 1);
+        if (name == "ipf" && !ParseNumber(value, e.ipf))
+            return false;
+        else if (name == "reachable" && !ParseNumber(value, e.reachable))
+            return false;
+        else if (name == "unknown" && !ParseNumber(value, e.unknown))
+            return false;
+        else if (name == "quirks")
+        {
+            e.quirks = 0;
+            for (unsigned int q=0; q<4; ++q)
+                if (("," + value + ",").find("," + QuirkNames(1 << q) + ",") != std::string::npos)
+                    e.quirks |= 1 << q;
+        }
+    }
+
+    const auto hash = line.find('#');
+    if (hash != std::string::npos && hash + 2 <= line.size())
+        e.file = line.substr(hash + 2);
+    out = e;
+    return true;
+}
+
+typedef std::map<std::string, Entry> Index;
+
+// Empty if there is no index
+inline Index Load(const std::string & path)
+{
+    Index index;
+    std::ifstream is(path);
+    std::string line;
+    while (std::getline(is, line))
+    {
+        Entry e;
+        if (Parse(line, e))
+            index[e.key] = e;
+    }
+    return index;
+}
+
+// Reads up to the entry of `key` only, for loaders that want one ROM out of a large index
+inline bool Find(const std::string & path, const std::string & key, Entry & e)
+{
+    std::ifstream is(path);
+    std::string line;
+    while (std::getline(is, line))
+        if (line.compare(0, key.size(), key) == 0 && line.size() > key.size() && line[key.size()] == ' ' && Parse(line, e))
+            return true;
+    return false;
+}
+
+inline bool Save(const std::string & path, const Index & index)
+{
+    const auto tmp = path + ".tmp";
+    {
+        std::ofstream os(tmp, std::ios::out | std::ios::trunc);
+        if (!os.is_open())
+            return false;
+        for (auto & [key, e] : index)
+            os << e << "\n";
+        if (!os)
+            return false;
+    }
+    return std::rename(tmp.c_str(), path.c_str()) == 0;
+}
+
+}
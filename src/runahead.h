@@ -0,0 +1,58 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+
+#include "src/libchip8.h"
+
+// Run-ahead over libchip8: every frame the machine advances one real frame, then is saved, run
+// `ahead` more frames with the same keys and restored. The picture of that future frame is what
+// gets presented, so a key shows on screen up to `ahead` frames sooner. The real timeline, and
+// so movies, captures, the sound timer and the retired instruction count, is the one without
+// run-ahead.
+//
+// A state is a little over 4 KiB and restoring it only rewrites the bytes the run-ahead frames
+// changed (see Memory::Update), so the cost is dominated by emulating the extra frames.
+class RunAhead
+{
+protected:
+    chip8_t * m;
+    unsigned int ahead;
+    std::vector<uint8_t> snapshot;
+    std::vector<uint8_t> video;                 // Presented frame when running ahead
+
+public:
+    RunAhead(chip8_t * machine, unsigned int frames) : m{machine}, ahead{frames} { };
+
+    unsigned int GetFrames() const { return ahead; };
+
+    // Advances one real frame with `keys`. Returns the frame to present and fills `regs` with
+    // the registers of the real frame.
+    const uint8_t * Step(uint16_t keys, uint32_t ipf, chip8_registers_t & regs, std::size_t * size = nullptr)
+    {
+        chip8_set_keys(m, keys);
+        chip8_step_frames(m, 1, ipf);
+        chip8_get_registers(m, &regs);
+
+        std::size_t video_size = 0;
+        const uint8_t * real = chip8_get_framebuffer(m, &video_size);
+        if (size)
+            *size = video_size;
+        if (!ahead || !chip8_is_running(m))
+            return real;
+
+        const auto needed = chip8_save_state(m, snapshot.data(), snapshot.size());
+        if (needed > snapshot.size())
+        {
+            snapshot.resize(needed);
+            chip8_save_state(m, snapshot.data(), snapshot.size());
+        }
+
+        chip8_step_frames(m, ahead, ipf);
+        video.assign(real, real + video_size);
+        chip8_load_state(m, snapshot.data(), needed);
+        chip8_restore_counters(m, &regs);
+        return video.data();
+    }
+};
@@ -0,0 +1,439 @@
+#pragma once
+
+#include <map>
+#include <cmath>
+#include <memory>
+#include <array>
+#include <vector>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <fstream>
+#include <cstdint>
+#include <iostream>
+
+#include <SDL2/SDL.h>
+
+#include "timer.h"
+#include "input.h"
+#include "display.h"
+#include "metrics.h"
+#include "filter.h"
+#include "triple.h"
+#include "profiler.h"
+
+// Host side of the SDL front end: window, keyboard and beeper. The emulation core knows nothing
+// about these, see libchip8.h.
+
+template<typename T, uint16_t HZ = 60, std::enable_if_t<std::is_integral<T>::value, bool> = true>
+class TimerSDL : public Timer<T, HZ>
+{
+protected:
+    SDL_TimerID id;
+public:
+    TimerSDL() : id{0}
+    {
+        SDL_InitSubSystem(SDL_INIT_TIMER);
+        id = SDL_AddTimer(1000 / HZ, [](Uint32 interval, void *param) {
+            Timer<T, HZ> * timer = static_cast<Timer<T, HZ>*>(param);
+            if (timer)
+            {
+                timer->Tick();
+                return (Uint32)(timer->IsEnabled() ? 1000 / HZ : 0);
+            }
+
+            return (Uint32)0;
+        }, this);
+    }
+
+    ~TimerSDL()
+    {
+        if (id)
+            SDL_RemoveTimer(id);
+        SDL_QuitSubSystem(SDL_INIT_TIMER);
+    }
+};
+
+template<typename T, uint16_t HZ = 60, std::enable_if_t<std::is_integral<T>::value, bool> = true>
+class TimerAudioSDL : public TimerSDL<T, HZ>
+{
+protected:
+    SDL_AudioSpec spec;
+    SDL_AudioDeviceID audio;
+    bool opened;                                // Device tried, see Open()
+    uint16_t tone;
+    uint32_t last_pos;
+    Metrics::Counters * metrics;                // Optional, counts late callbacks as underruns
+    std::chrono::steady_clock::time_point last_callback;
+
+public:
+
+    TimerAudioSDL(uint16_t tone=440, uint32_t frequency=22000) :    spec{
+                                                                        .freq = static_cast<int>(frequency),
+                                                                        .format = AUDIO_S16SYS,
+                                                                        .channels = 1,
+                                                                        .samples = 1,
+                                                                        .userdata = this
+                                                                    },
+                                                                    audio{0},
+                                                                    opened{false},
+                                                                    tone{tone},
+                                                                    last_pos{0},
+                                                                    metrics{nullptr}
+    {
+        spec.callback = [](void* userdata, unsigned char* stream, int len)
+        {
+            TimerAudioSDL<T, HZ> * timer = static_cast<TimerAudioSDL<T, HZ> *>(userdata);
+            Profiler::NameThread("audio");
+            Profiler::Probe probe(Profiler::Region::Audio);
+
+            // The device drained its buffer if we are called later than twice its length
+            if (timer->metrics)
+            {
+                const auto now = std::chrono::steady_clock::now();
+                const auto buffer = std::chrono::duration<double>(double(len / 2) / timer->spec.freq);
+                if (timer->last_callback.time_since_epoch().count() && now - timer->last_callback > 2 * buffer)
+                    Metrics::Counters::Add(timer->metrics->underruns, 1);
+                timer->last_callback = now;
+            }
+
+            if (!timer->IsEnabled() || !timer->timer)
+            {
+                // Fill with silence
+                SDL_memset(stream, timer->spec.silence, len);
+                return;
+            }
+
+            const auto amplitude = 0.5;
+
+            int16_t * stream16 = (int16_t*)stream;
+            len /= 2;
+            for (auto i=0; i<len; ++i)
+            {
+                stream16[i] = static_cast<int16_t>(std::sin(timer->last_pos * timer->tone * M_PI * 2 / timer->spec.freq) * 32567 * amplitude);
+                if (++timer->last_pos >= timer->spec.freq)
+                    timer->last_pos = 0;
+            }
+        };
+    }
+
+    // Opening the audio device takes longer than everything else at startup together, and most
+    // ROMs beep late or never: it is opened by the first sound instead. Only tried once.
+    void Open()
+    {
+        opened = true;
+        if (SDL_InitSubSystem(SDL_INIT_AUDIO))
+            return;
+        audio = SDL_OpenAudioDevice(nullptr, 0, &spec, nullptr, 0);
+        SDL_PauseAudioDevice(audio, 0);
+    }
+
+    void Set(T v)
+    {
+        if (v && !opened)
+            Open();
+        Timer<T, HZ>::Set(v);
+    }
+
+    // Before the first sound
+    void SetMetrics(Metrics::Counters * c) { metrics = c; };
+
+    ~TimerAudioSDL()
+    {
+        if (audio)
+            SDL_CloseAudioDevice(audio);
+        audio = 0;
+        if (opened)
+            SDL_QuitSubSystem(SDL_INIT_AUDIO);
+    }
+};
+
+class InputSDL : public Input
+{
+protected:
+    std::map<Key, SDL_Scancode> to_sdl;
+    std::map<SDL_Scancode, Key> from_sdl;
+
+public:
+    InputSDL(const std::array<std::string, gInputTotalKeys> & keymap = {    "X", "1", "2", "3",
+                                                                            "Q", "W", "E", "A",
+                                                                            "S", "D", "Z", "C",
+                                                                            "V", "4", "R", "F" })
+    {
+        SDL_InitSubSystem(SDL_INIT_EVENTS);
+        for (auto i=0; i<gInputTotalKeys; ++i)
+        {
+            auto k_index = Key((int)Key::K1 + i);
+            auto k_scan = SDL_GetScancodeFromName(keymap[i].c_str());
+
+            to_sdl[k_index] = k_scan;
+            from_sdl[k_scan] = k_index;
+        }
+    }
+
+    bool IsPressed(Key k)
+    {
+        int numkeys = 0;
+        const Uint8* sdl_keys = SDL_GetKeyboardState(&numkeys);
+
+        auto k_scan = to_sdl[k];
+        if (k_scan < numkeys)
+            return sdl_keys[k_scan];
+        return false;
+    }
+
+    // The machine suspends on fX0a rather than waiting here (see CHIP8Core::Wait)
+    Key GetKey()
+    {
+        SDL_PumpEvents();
+        for (auto ksdl : to_sdl)
+            if (IsPressed(ksdl.first))
+                return ksdl.first;
+        return Key::_invalid;
+    }
+
+    bool LoadKeymap(const std::string & file)
+    {
+        std::ifstream f(file);
+        if (!f.is_open())
+            return false;
+
+        std::map<Key, SDL_Scancode> new_to_sdl;
+        std::map<SDL_Scancode, Key> new_from_sdl;
+
+        const std::string comments{ "#/" };
+        const std::string separator{ " \t"};
+
+        std::string line;
+        while (std::getline(f, line))
+        {
+            std::cout << "Parsing line: " << line << std::endl;
+
+            auto end = std::find_first_of(line.begin(), line.end(), comments.begin(), comments.end());
+            auto sep = std::find_first_of(line.begin(), end, separator.begin(), separator.end());
+            if (sep != end)
+            {
+                std::string_view sv_key(line.begin(), sep);
+
+                std::size_t key_end;
+                char key = std::stol(std::string(sv_key), &key_end, 16) & 0xff;
+
+                std::cout << "  sv_key=" << sv_key << " key=0x" << std::hex << +key << std::endl;
+
+                auto sdl_key = line.find_first_not_of(separator, key_end);
+
+                std::string_view sv_sdlkey(line.begin() + sdl_key, end);
+
+                std::cout << "  sv_sdlkey=" << sv_sdlkey << std::endl;
+
+                auto k_scan = SDL_GetScancodeFromName(std::string(sv_sdlkey).c_str());
+                if (k_scan != SDL_SCANCODE_UNKNOWN)
+                {
+                    Key k_index = Key(key);
+                    new_to_sdl[k_index] = k_scan;
+                    new_from_sdl[k_scan] = k_index;
+                }
+            }
+        }
+        f.close();
+
+        if (new_to_sdl.size() > 1)
+        {
+            to_sdl.clear();
+            to_sdl = std::move(new_to_sdl);
+
+            from_sdl.clear();
+            from_sdl = std::move(new_from_sdl);
+        }
+
+        return true;
+    }
+};
+
+class DisplaySDL : public Display<DisplaySDL>
+{
+protected:
+    static constexpr int HUD_LINES = 6;
+    static constexpr int HUD_PIXEL = 2;         // Size of a font pixel in window pixels
+
+    // A frame rendered by Render(), for Show() to put on the window
+    struct Picture
+    {
+        std::vector<uint8_t> bits;              // As submitted
+        std::vector<uint32_t> pixels;           // Filtered, GetOutW() pixels per row
+        bool filtered;                          // Otherwise drawn from the bits pixel by pixel
+    };
+
+    SDL_Window * window;
+    SDL_Surface * surface;
+    std::unique_ptr<Filter::Upscaler> filter;   // Scales whole frames for the surface
+    bool direct;                                // The surface takes the filter output as it is
+    TripleBuffer<Picture> pictures;
+    Metrics::Counters * metrics;                // Optional, counts presented frames
+    bool hud;                                   // Draw the metrics over the frame
+    Metrics::Snapshot hud_last;
+    char hud_text[HUD_LINES][32];
+
+    // 3x5 font, rows top to bottom, 3 bits per row. Only what the HUD prints.
+    static uint16_t Glyph(char c)
+    {
+        static const char chars[] = "0123456789.-ADEFILMNPRSTU";
+        static const uint16_t glyphs[] = {
+            075557, 026227, 071747, 071717, 055711, 074717, 074757, 071111, 075757, 075717, 000002, 000700,
+            025755, 065556, 074647, 074644, 072227, 044447, 057755, 065555, 065644, 065655, 034216, 072222, 055557
+        };
+
+        for (std::size_t i=0; i<sizeof(glyphs) / sizeof(glyphs[0]); ++i)
+            if (chars[i] == c)
+                return glyphs[i];
+        return 0;
+    }
+
+    void DrawText(int x, int y, const char * text, uint32_t color)
+    {
+        for (; *text; ++text, x += 4 * HUD_PIXEL)
+        {
+            const auto g = Glyph(*text);
+            for (int row=0; row<5; ++row)
+                for (int col=0; col<3; ++col)
+                    if ((g >> ((4 - row) * 3 + (2 - col))) & 0x1)
+                    {
+                        SDL_Rect rect{ .x = x + col * HUD_PIXEL, .y = y + row * HUD_PIXEL, .w = HUD_PIXEL, .h = HUD_PIXEL };
+                        SDL_FillRect(surface, &rect, color);
+                    }
+        }
+    }
+
+    void DrawHud()
+    {
+        // Rates over half a second, so that the numbers can be read
+        const auto now = Metrics::Snapshot::Take(*metrics);
+        if (now.time - hud_last.time >= std::chrono::milliseconds(500))
+        {
+            const auto r = Metrics::Rates::Between(hud_last, now);
+            std::snprintf(hud_text[0], sizeof(hud_text[0]), "IPS %.0f", r.ips);
+            std::snprintf(hud_text[1], sizeof(hud_text[1]), "FPS %.1f", r.fps);
+            std::snprintf(hud_text[2], sizeof(hud_text[2]), "EMU MS %.3f", r.emulation_ms);
+            std::snprintf(hud_text[3], sizeof(hud_text[3]), "DRIFT MS %.1f", r.drift_ms);
+            std::snprintf(hud_text[4], sizeof(hud_text[4]), "UNDERRUNS %llu", (unsigned long long)now.underruns);
+            std::snprintf(hud_text[5], sizeof(hud_text[5]), "LAT MS %.1f", r.input_latency_ms);
+            hud_last = now;
+        }
+
+        const int line = 7 * HUD_PIXEL;
+        SDL_Rect box{ .x = 0, .y = 0, .w = 16 * 4 * HUD_PIXEL + 2 * HUD_PIXEL, .h = HUD_LINES * line + HUD_PIXEL };
+        SDL_FillRect(surface, &box, 0x202020);
+        for (int l=0; l<HUD_LINES; ++l)
+            DrawText(2 * HUD_PIXEL, 2 * HUD_PIXEL + l * line, hud_text[l], 0x00ff00);
+    }
+
+    friend class Display<DisplaySDL>;
+
+    void DrawPixel(uint16_t x, uint16_t y, uint32_t color)
+    {
+        SDL_Rect rect{
+            .x = x * scale,
+            .y = y * scale,
+            .w = scale,
+            .h = scale
+        };
+        SDL_FillRect(surface, &rect, color);
+    }
+
+    void Present()
+    {
+        Profiler::Probe probe(Profiler::Region::Present);
+        if (metrics)
+        {
+            Metrics::Counters::Add(metrics->presented, 1);
+            if (hud && surface != NULL)
+                DrawHud();
+        }
+        SDL_UpdateWindowSurface(window);
+    }
+
+public:
+    DisplaySDL(uint16_t w, uint16_t h, uint16_t s) : Display(w, h, s), window(NULL), surface(NULL), direct(false), metrics(NULL), hud(false), hud_last{}, hud_text{}
+    {
+        SDL_InitSubSystem(SDL_INIT_VIDEO);
+        window = SDL_CreateWindow("display", 0, 0, width * scale, height * scale, SDL_WINDOW_SHOWN | SDL_WINDOW_MOUSE_FOCUS);
+        if (window != NULL)
+            surface = SDL_GetWindowSurface(window);
+        SetFilter(Filter::Options{});
+    }
+
+    // Before rendering starts. The scale always is the window one.
+    void SetFilter(Filter::Options opt)
+    {
+        opt.scale = scale;
+        filter = std::make_unique<Filter::Upscaler>(width, height, opt);
+        direct = surface != NULL && surface->format->BytesPerPixel == 4
+              && surface->w >= int(filter->GetOutW()) && surface->h >= int(filter->GetOutH());
+    }
+
+    // Any thread, one at a time: whole frames go through the filter when the surface takes
+    // 32-bit pixels, and are kept for Show() to draw pixel by pixel otherwise. Makes no SDL calls.
+    void Render(const uint8_t * first, const uint8_t * last)
+    {
+        Profiler::Probe probe(Profiler::Region::DisplayDraw);
+        auto & p = pictures.Back();
+        p.bits.assign(first, last);
+        p.filtered = direct && last - first >= width * height / 8;
+        if (p.filtered)
+        {
+            p.pixels.resize(filter->GetOutW() * filter->GetOutH());
+            filter->Process(first, p.pixels.data(), filter->GetOutW());
+        }
+        pictures.Publish();
+    }
+
+    // On the thread that created the window: puts the latest rendered frame on it. Returns
+    // false when nothing was rendered since the last call.
+    bool Show()
+    {
+        if (!pictures.Update())
+            return false;
+
+        const auto & p = pictures.Front();
+        if (!p.filtered)
+        {
+            Display::Draw(p.bits.begin(), p.bits.end());
+            return true;
+        }
+
+        const auto ow = filter->GetOutW();
+        SDL_LockSurface(surface);
+        for (std::size_t y=0; y<filter->GetOutH(); ++y)
+            std::copy_n(p.pixels.data() + y * ow, ow, static_cast<uint32_t *>(surface->pixels) + y * (surface->pitch / 4));
+        SDL_UnlockSurface(surface);
+        Present();
+        return true;
+    }
+
+    // Before presenting starts. With `overlay` the HUD is drawn over every frame.
+    void SetMetrics(Metrics::Counters * c, bool overlay)
+    {
+        metrics = c;
+        hud = overlay;
+        if (metrics)
+            hud_last = Metrics::Snapshot::Take(*metrics);
+    }
+
+    // Refresh rate of the monitor showing the window, 60 when unknown
+    unsigned int GetRefreshRate() const
+    {
+        SDL_DisplayMode mode{};
+        if (window == NULL || SDL_GetWindowDisplayMode(window, &mode) || mode.refresh_rate <= 0)
+            return 60;
+        return mode.refresh_rate;
+    }
+
+    ~DisplaySDL()
+    {
+        surface = NULL;
+        if (window != NULL)
+            SDL_DestroyWindow(window);
+        window = NULL;
+        SDL_QuitSubSystem(SDL_INIT_VIDEO);
+    }
+};
@@ -0,0 +1,145 @@
+#pragma once
+
+#include <limits>
+#include <string>
+#include <sstream>
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+
+#include "state.h"
+#include "reference.h"
+
+// Runs a production machine and CHIP8Reference in lockstep. Both see the same keys and timer
+// ticks; every `every` retired instructions the hashes of both states are compared, and the
+// machine incremental state hash is checked against a full recompute. On the first divergence
+// both states and the last instructions of the reference are dumped.
+template <class tMachine>
+class Shadow
+{
+public:
+    enum class Status { Running, Diverged, Halted, Unsupported };
+
+protected:
+    tMachine & machine;
+    CHIP8Reference ref;
+    uint64_t every;
+    uint64_t next_check;
+    uint64_t checks;
+    bool hash_ok;                               // Incremental hash always matched the full one
+    Status status;
+    CHIP8State state;                           // Scratch for the production state
+
+    bool Check()
+    {
+        ++checks;
+
+        // The incremental hash must agree with a recompute, and with the reference
+        const auto hash = machine.StateHash();
+        hash_ok = hash_ok && hash == machine.FullStateHash();
+        return hash_ok && hash == ref.GetState().Hash();
+    }
+
+public:
+    Shadow(tMachine & m, uint64_t every = 1000, std::size_t history = 32) : machine{m}, ref{history}, every{std::max<uint64_t>(every, 1)},
+                                                                          checks{0}, hash_ok{true}, status{Status::Running}
+    {
+        machine.SaveState(state);
+        ref.Load(state);
+        ref.SetRetired(machine.GetRetired());
+        next_check = machine.GetRetired() + every;
+    }
+
+    Status GetStatus() const { return status; };
+    uint64_t GetChecks() const { return checks; };
+
+    void SetKeys(uint16_t mask)
+    {
+        machine.GetInput().SetKeys(mask);
+        ref.SetKeys(mask);
+    }
+
+    // Same contract as CHIP8Core::RunFrame
+    Status RunFrame(unsigned int ipf)
+    {
+        if (status != Status::Running)
+            return status;
+
+        const auto target = machine.GetRetired() + ipf;
+        machine.SetLimit(target);
+        while (machine.GetRetired() < target && machine.IsRunning() && !machine.Suspended())
+        {
+            machine.Task();
+
+            // Fused handlers retire several instructions at once
+            while (ref.GetRetired() < machine.GetRetired() && ref.GetStatus() == CHIP8Reference::Status::Running)
+                ref.Step();
+
+            // The machine stopped on a fetch: let the reference stop on the same one
+            if (!machine.IsRunning())
+                ref.Step();
+
+            if (ref.GetStatus() == CHIP8Reference::Status::Unsupported)
+            {
+                status = Status::Unsupported;
+                break;
+            }
+
+            if (machine.GetRetired() >= next_check || !machine.IsRunning())
+            {
+                next_check = machine.GetRetired() + every;
+                if (!Check())
+                {
+                    status = Status::Diverged;
+                    break;
+                }
+            }
+        }
+        machine.SetLimit(std::numeric_limits<uint64_t>::max());
+
+        if (status == Status::Running)
+        {
+            machine.TickTimers();
+            ref.TickTimers();
+            if (!machine.IsRunning())
+                status = Check() ? Status::Halted : Status::Diverged;
+        }
+
+        return status;
+    }
+
+    void Dump(std::ostream & os)
+    {
+        machine.SaveState(state);
+        auto & r = ref.GetState();
+
+        auto hex = [](uint64_t v, int w) { std::stringstream ss; ss << std::hex << std::setw(w) << std::setfill('0') << v; return ss.str(); };
+        auto row = [&](const std::string & name, uint64_t a, uint64_t b, int w)
+        {
+            os << "  " << std::setw(6) << std::left << name << std::right << " " << hex(a, w) << "  " << hex(b, w) << (a != b ? "  <--" : "") << "\n";
+        };
+
+        os << "  retired " << std::dec << machine.GetRetired() << "\n";
+        if (!hash_ok)
+            os << "  incremental state hash does not match the full recompute\n";
+        os << "         machine  reference\n";
+        row("PC", state.PC, r.PC, 4);
+        row("I", state.I, r.I, 4);
+        for (auto i=0; i<16; ++i)
+            row("V" + hex(i, 1), state.V[i], r.V[i], 2);
+        row("delay", state.delay, r.delay, 2);
+        row("sound", state.sound, r.sound, 2);
+        row("dwait", state.disp_wait, r.disp_wait, 2);
+        row("sp", state.stack.size(), r.stack.size(), 2);
+        for (std::size_t i=0; i<std::min(state.stack.size(), r.stack.size()); ++i)
+            row("s" + std::to_string(i), state.stack[i], r.stack[i], 4);
+
+        for (std::size_t a=0; a<state.ram.size(); ++a)
+            if (state.ram[a] != r.ram[a])
+                row("[" + hex(a, 3) + "]", state.ram[a], r.ram[a], 2);
+
+        os << "  last instructions:\n";
+        for (auto & t : ref.GetHistory())
+            os << "    " << hex(t.PC, 4) << ": " << hex(t.op, 4) << "\n";
+    }
+};
@@ -0,0 +1,215 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <string>
+#include <cstdint>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+// Frame export to other processes through POSIX shared memory (shm_open).
+//
+// The emulator publishes every frame (framebuffer, registers, frame counter) into a ring of
+// slots, each guarded by its own seqlock: the sequence is odd while the slot is being written.
+// Readers copy a slot and retry if the sequence changed meanwhile, so they never block the
+// emulator. The emulator never waits on a reader either: a slow reader just skips frames.
+//
+// Keys go the other way through a single producer / single consumer ring of key masks. The
+// emulator drains it once per frame and keeps the last mask; a full ring rejects the push.
+namespace SharedMemory
+{
+
+const uint32_t MAGIC = 0x43385348;              // "C8SH"
+const uint32_t VERSION = 1;
+const std::size_t FRAME_SLOTS = 8;
+const std::size_t INPUT_SLOTS = 64;
+const std::size_t VIDEO_SIZE = 64 * 32 / 8;
+
+struct Frame
+{
+    uint64_t frame;                             // Frames run so far, 1 for the first one
+    std::array<uint8_t, VIDEO_SIZE> video;      // 64x32, 1 bit per pixel, MSB first
+    std::array<uint8_t, 16> V;
+    uint16_t I;
+    uint16_t PC;
+    uint8_t delay;
+    uint8_t sound;
+    uint16_t keys;                              // Keys the frame ran with
+};
+
+struct Slot
+{
+    std::atomic<uint64_t> seq;
+    Frame data;
+};
+
+struct Layout
+{
+    uint32_t magic;
+    uint32_t version;
+    std::atomic<uint64_t> latest;               // Frame number of the newest complete slot, 0 = none
+    std::array<Slot, FRAME_SLOTS> frames;       // Frame N lives in slot N % FRAME_SLOTS
+
+    alignas(64) std::atomic<uint64_t> input_head;  // Written by the key producer
+    alignas(64) std::atomic<uint64_t> input_tail;  // Written by the emulator
+    std::array<uint16_t, INPUT_SLOTS> inputs;
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "Shared memory atomics must be lock free");
+
+// Maps a named segment, creating it (and owning its name) or attaching to an existing one
+class Segment
+{
+protected:
+    std::string name;
+    Layout * layout;
+    bool owner;
+
+public:
+    Segment() : layout{nullptr}, owner{false} { };
+    Segment(const Segment &) = delete;
+    Segment& operator=(const Segment &) = delete;
+
+    virtual ~Segment()
+    {
+        if (layout)
+            munmap(layout, sizeof(Layout));
+        if (owner)
+            shm_unlink(name.c_str());
+    }
+
+    bool Create(const std::string & n)
+    {
+        name = n;
+        const int fd = shm_open(name.c_str(), O_CREAT | O_RDWR | O_TRUNC, 0600);
+        if (fd < 0)
+            return false;
+
+        void * p = MAP_FAILED;
+        if (ftruncate(fd, sizeof(Layout)) == 0)
+            p = mmap(nullptr, sizeof(Layout), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (p == MAP_FAILED)
+        {
+            shm_unlink(name.c_str());
+            return false;
+        }
+
+        // Fresh pages are zeroed, which is a valid state for every atomic in there
+        owner = true;
+        layout = static_cast<Layout*>(p);
+        layout->version = VERSION;
+        std::atomic_thread_fence(std::memory_order_release);
+        layout->magic = MAGIC;
+        return true;
+    }
+
+    bool Attach(const std::string & n)
+    {
+        name = n;
+        const int fd = shm_open(name.c_str(), O_RDWR, 0);
+        if (fd < 0)
+            return false;
+
+        void * p = mmap(nullptr, sizeof(Layout), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (p == MAP_FAILED)
+            return false;
+
+        layout = static_cast<Layout*>(p);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return layout->magic == MAGIC && layout->version == VERSION;
+    }
+
+    bool IsOpen() const { return layout != nullptr; };
+};
+
+// Emulator side
+class Exporter : public Segment
+{
+    uint64_t frame = 0;
+    uint16_t keys = 0;
+
+public:
+    // Returns the slot to fill for the next frame. Nothing else may touch the shared memory
+    // between Begin() and End().
+    Frame & Begin()
+    {
+        auto & slot = layout->frames[(frame + 1) % FRAME_SLOTS];
+        slot.seq.store(slot.seq.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        return slot.data;
+    }
+
+    void End()
+    {
+        auto & slot = layout->frames[++frame % FRAME_SLOTS];
+        slot.data.frame = frame;
+        slot.seq.store(slot.seq.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        layout->latest.store(frame, std::memory_order_release);
+    }
+
+    // Drains the key ring; with nothing new, the previous mask stays pressed
+    uint16_t PollKeys()
+    {
+        auto tail = layout->input_tail.load(std::memory_order_relaxed);
+        const auto head = layout->input_head.load(std::memory_order_acquire);
+        if (tail == head)
+            return keys;
+
+        keys = layout->inputs[(head - 1) % INPUT_SLOTS];
+        layout->input_tail.store(head, std::memory_order_release);
+        return keys;
+    }
+};
+
+// Consumer side. Any number of processes may read frames; only one may push keys.
+class Viewer : public Segment
+{
+public:
+    // Copies the newest frame. False if nothing was published yet.
+    bool ReadLatest(Frame & out) const
+    {
+        while (true)
+        {
+            const auto latest = layout->latest.load(std::memory_order_acquire);
+            if (!latest)
+                return false;
+
+            if (Read(latest, out))
+                return true;
+        }
+    }
+
+    // Copies a given frame. False if it is not in the ring (too old, not there yet) or got
+    // overwritten while reading.
+    bool Read(uint64_t frame, Frame & out) const
+    {
+        auto & slot = layout->frames[frame % FRAME_SLOTS];
+        const auto before = slot.seq.load(std::memory_order_acquire);
+        if (before & 0x1)
+            return false;
+
+        std::memcpy(&out, &slot.data, sizeof(Frame));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return slot.seq.load(std::memory_order_relaxed) == before && out.frame == frame;
+    }
+
+    uint64_t Latest() const { return layout->latest.load(std::memory_order_acquire); };
+
+    bool PushKeys(uint16_t mask)
+    {
+        const auto head = layout->input_head.load(std::memory_order_relaxed);
+        if (head - layout->input_tail.load(std::memory_order_acquire) >= INPUT_SLOTS)
+            return false;
+
+        layout->inputs[head % INPUT_SLOTS] = mask;
+        layout->input_head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+};
+
+}
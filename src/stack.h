@@ -0,0 +1,53 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include "hash.h"
+
+// Call stack with the std::stack interface the instructions use, plus iteration (bottom first)
+// and an incrementally maintained hash of its contents. It holds up to DEPTH return addresses;
+// callers check full() before a push.
+template <typename T>
+class CallStack
+{
+protected:
+    std::vector<T> data;
+    uint64_t hash;
+
+public:
+    static constexpr std::size_t DEPTH = 16;    // Conventional CHIP-8 limit
+
+    // Reserved up front, so that calls do not allocate
+    CallStack() : hash{0} { data.reserve(DEPTH); };
+
+    void push(T v)
+    {
+        hash ^= StateHash::Word(StateHash::KEY_STACK + data.size(), v);
+        data.push_back(v);
+    };
+
+    void pop()
+    {
+        hash ^= StateHash::Word(StateHash::KEY_STACK + data.size() - 1, data.back());
+        data.pop_back();
+    };
+
+    T top() const { return data.back(); };
+    std::size_t size() const { return data.size(); };
+    bool empty() const { return data.empty(); };
+    bool full() const { return data.size() >= DEPTH; };
+
+    void clear()
+    {
+        data.clear();
+        hash = 0;
+    };
+
+    typename std::vector<T>::const_iterator begin() const { return data.begin(); };
+    typename std::vector<T>::const_iterator end() const { return data.end(); };
+
+    bool operator==(const CallStack & o) const { return data == o.data; };
+
+    uint64_t Hash() const { return hash; };
+};
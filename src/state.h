@@ -0,0 +1,117 @@
+#pragma once
+
+#include <array>
+#include <vector>
+#include <random>
+#include <cstdint>
+#include <cstring>
+
+#include "hash.h"
+#include "stack.h"
+
+// Plain copy of everything a CHIP-8 program can observe or influence. It is what gets saved,
+// restored, hashed and compared; the machine objects themselves are never copied.
+struct CHIP8State
+{
+    std::array<uint8_t, 4096> ram;
+    std::array<uint8_t, 16> V;
+    uint16_t I;
+    uint64_t PC;
+    std::vector<uint16_t> stack;                // Bottom first
+    uint8_t delay;
+    uint8_t sound;
+    uint8_t disp_wait;
+    std::minstd_rand rng;
+
+    bool operator==(const CHIP8State & o) const
+    {
+        return ram == o.ram && V == o.V && I == o.I && PC == o.PC && stack == o.stack
+            && delay == o.delay && sound == o.sound && disp_wait == o.disp_wait && rng == o.rng;
+    }
+
+    // Full recompute of the hash CHIP8Core maintains incrementally (the RNG is not part of it)
+    uint64_t Hash() const
+    {
+        using namespace StateHash;
+
+        uint64_t h = 0;
+        for (std::size_t a=0; a<ram.size(); ++a)
+            h ^= Byte(a, ram[a]);
+        for (std::size_t i=0; i<V.size(); ++i)
+            h ^= Word(KEY_V + i, V[i]);
+        for (std::size_t d=0; d<stack.size(); ++d)
+            h ^= Word(KEY_STACK + d, stack[d]);
+
+        return h ^ Word(KEY_I, I) ^ Word(KEY_PC, PC) ^ Word(KEY_DELAY, delay) ^ Word(KEY_SOUND, sound) ^ Word(KEY_DISP_WAIT, disp_wait);
+    }
+
+    // The generator keeps its last output x and returns A * x mod M next: x is recovered from a
+    // copy with the inverse of A, which is what streaming it out would print, without iostreams
+    uint32_t RngState() const
+    {
+        static constexpr uint64_t M = std::minstd_rand::modulus;
+        static constexpr uint64_t INVERSE = 1899818559;
+        static_assert(std::minstd_rand::multiplier * INVERSE % M == 1);
+
+        auto next = rng;
+        return uint32_t(next() * INVERSE % M);
+    }
+
+    // Flat little endian image, for files and the C API:
+    //   "C8ST" | ram | V | I u16 | PC u16 | delay | sound | disp_wait | rng u32 | depth u16 | stack u16...
+    static constexpr std::size_t FIXED_SIZE = 4 + 4096 + 16 + 2 + 2 + 3 + 4 + 2;
+
+    std::size_t SerializedSize() const { return FIXED_SIZE + 2 * stack.size(); };
+
+    // Writes SerializedSize() bytes
+    void Serialize(uint8_t * out) const
+    {
+        auto put = [&out](uint32_t v, int bytes) { for (int b=0; b<bytes; ++b) *out++ = uint8_t(v >> (8 * b)); };
+
+        std::memcpy(out, "C8ST", 4);
+        out += 4;
+        out = std::copy(ram.begin(), ram.end(), out);
+        out = std::copy(V.begin(), V.end(), out);
+        put(I, 2);
+        put(PC, 2);
+        put(delay, 1);
+        put(sound, 1);
+        put(disp_wait, 1);
+
+        put(RngState(), 4);
+
+        put(stack.size(), 2);
+        for (auto v : stack)
+            put(v, 2);
+    }
+
+    // False if the image is malformed, leaving the state untouched
+    bool Deserialize(const uint8_t * in, std::size_t size)
+    {
+        if (size < FIXED_SIZE || std::memcmp(in, "C8ST", 4))
+            return false;
+
+        auto get = [](const uint8_t * p, int bytes) { uint32_t v = 0; for (int b=0; b<bytes; ++b) v |= uint32_t(p[b]) << (8 * b); return v; };
+
+        const uint8_t * regs = in + 4 + 4096 + 16;
+        const std::size_t depth = get(regs + 11, 2);
+        if (size != FIXED_SIZE + 2 * depth || depth > CallStack<uint16_t>::DEPTH)
+            return false;
+
+        std::copy(in + 4, in + 4 + 4096, ram.begin());
+        std::copy(in + 4 + 4096, regs, V.begin());
+        I = get(regs, 2);
+        PC = get(regs + 2, 2);
+        delay = regs[4];
+        sound = regs[5];
+        disp_wait = regs[6];
+
+        // Same as streaming the state in: it is always in [1, modulus)
+        rng.seed(get(regs + 7, 4));
+
+        stack.resize(depth);
+        for (std::size_t d=0; d<depth; ++d)
+            stack[d] = get(regs + 13 + 2 * d, 2);
+        return true;
+    }
+};
@@ -0,0 +1,369 @@
+// chip8-aot: translates a CHIP-8 ROM into a C++ translation unit with one function per
+// basic block. The output builds against src/aot.h (see CHIP8_AOT_ROMS in CMakeLists.txt).
+
+#include <map>
+#include <set>
+#include <deque>
+#include <vector>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <iostream>
+
+#include "src/machine.h"
+#include "src/headless.h"
+
+namespace
+{
+
+const unsigned int ENTRY = CHIP8Core<HeadlessBackend>::MEMORY_USABLE;
+typedef CHIP8Core<HeadlessBackend>::MemorySpecs Ram;
+
+enum class Kind
+{
+    Native,                                     // Translated inline
+    Service,                                    // Needs the machine services (timer writes, input, display, rand)
+    Jump,                                       // 1NNN
+    Call,                                       // 2NNN
+    Return,                                     // 00EE
+    Skip,                                       // 3XNN 4XNN 5XY0 9XY0
+    Computed,                                   // BNNN
+    Invalid                                     // Ends the block, left to the interpreter
+};
+
+Kind Classify(uint16_t op)
+{
+    CHIP8OpParse p(op);
+    switch (op >> 12)
+    {
+    case 0x0:
+        if (op == 0x00ee) return Kind::Return;
+        if (op == 0x00e0) return Kind::Service;
+        return Kind::Invalid;
+    case 0x1: return Kind::Jump;
+    case 0x2: return Kind::Call;
+    case 0x3: case 0x4: return Kind::Skip;
+    case 0x5: case 0x9: return p.N == 0 ? Kind::Skip : Kind::Invalid;
+    case 0x6: case 0x7: case 0xa: return Kind::Native;
+    case 0x8: return (p.N <= 0x7 || p.N == 0xe) ? Kind::Native : Kind::Invalid;
+    case 0xb: return Kind::Computed;
+    case 0xc: case 0xd: return Kind::Service;
+    case 0xe: return (p.NN == 0x9e || p.NN == 0xa1) ? Kind::Service : Kind::Invalid;
+    case 0xf:
+        switch (p.NN)
+        {
+        case 0x07: case 0x1e: case 0x29: case 0x33: case 0x55: case 0x65: return Kind::Native;
+        case 0x0a: case 0x15: case 0x18: return Kind::Service;
+        }
+    }
+    return Kind::Invalid;
+}
+
+// fX33 and fX55 may rewrite code, so the block ends right after them
+bool WritesMemory(uint16_t op)
+{
+    return (op >> 12) == 0xf && ((op & 0xff) == 0x33 || (op & 0xff) == 0x55);
+}
+
+class Translator
+{
+protected:
+    std::vector<uint8_t> rom;
+    std::set<uint16_t> reachable;
+    std::set<uint16_t> leaders;
+
+    bool InRom(uint32_t addr) const { return addr >= ENTRY && addr + 1 < ENTRY + rom.size(); };
+    uint16_t OpAt(uint16_t addr) const { return rom[addr - ENTRY] << 8 | rom[addr - ENTRY + 1]; };
+
+    bool SkipsJump(uint16_t addr) const { return InRom(addr + 2) && Classify(OpAt(addr + 2)) == Kind::Jump; };
+
+    std::string Hex(uint32_t v, int w=4) const
+    {
+        std::stringstream ss;
+        ss << "0x" << std::hex << std::setw(w) << std::setfill('0') << v;
+        return ss.str();
+    }
+
+public:
+    Translator(std::vector<uint8_t> && image) : rom{std::move(image)} { };
+
+    // Walks the control flow graph from the entry point marking reachable instructions
+    // and block leaders.
+    void Explore()
+    {
+        std::deque<uint16_t> work{ uint16_t(ENTRY) };
+        leaders.insert(ENTRY);
+
+        auto branch = [&](uint32_t to)
+        {
+            if (!InRom(to))
+                return;
+            leaders.insert(to);
+            work.push_back(to);
+        };
+
+        // Straight line code going on into the next page starts a new block there
+        auto next = [&](uint32_t from)
+        {
+            if (Ram::Page(from + 2) != Ram::Page(from))
+                branch(from + 2);
+            else
+                work.push_back(from + 2);
+        };
+
+        while (!work.empty())
+        {
+            auto addr = work.front();
+            work.pop_front();
+            if (!InRom(addr) || !reachable.insert(addr).second)
+                continue;
+
+            const auto op = OpAt(addr);
+            CHIP8OpParse p(op);
+            switch (Classify(op))
+            {
+            case Kind::Native:
+                if (WritesMemory(op))
+                    branch(addr + 2);
+                else
+                    next(addr);
+                break;
+            case Kind::Service:
+                leaders.insert(addr);
+                if ((op >> 12) == 0xe)
+                {
+                    // eX9e / eXa1 are skips on the key state
+                    branch(addr + 2);
+                    branch(addr + 4);
+                }
+                else
+                    next(addr);
+                break;
+            case Kind::Jump:
+                branch(p.NNN);
+                break;
+            case Kind::Call:
+                branch(p.NNN);
+                branch(addr + 2);
+                break;
+            case Kind::Skip:
+                branch(addr + 2);
+                branch(addr + 4);
+                break;
+            case Kind::Return:
+            case Kind::Computed:
+            case Kind::Invalid:
+                break;
+            }
+        }
+    }
+
+    // Emits a single instruction. Returns false when the block ends after it.
+    bool EmitOp(std::ostream & os, uint16_t addr, uint16_t op) const
+    {
+        CHIP8OpParse p(op);
+        const std::string X = std::to_string(p.X);
+        const std::string Y = std::to_string(p.Y);
+        const std::string next = Hex(addr + 2);
+
+        os << "    // " << Hex(addr) << ": " << Hex(op) << "\n";
+
+        if (Classify(op) == Kind::Service)
+        {
+            os << "    m.PC = " << Hex(addr) << ";\n";
+            os << "    m.Interpret();\n";
+            if ((op >> 12) == 0xe)
+                return false;
+            os << "    if (m.PC != " << next << ") return;\n";
+            return true;
+        }
+
+        os << "    m.PC = " << next << ";\n";
+
+        switch (Classify(op))
+        {
+        case Kind::Service:
+            break;
+        case Kind::Jump:
+            os << "    ++m.retired;\n";
+            os << "    Instructions::AssignV<uint64_t, uint16_t>(&m.PC, " << Hex(p.NNN) << ");\n";
+            return false;
+        case Kind::Call:
+            os << "    if (m.stack.full()) { m.PC = " << Hex(addr) << "; m.Interpret(); return; }\n";
+            os << "    ++m.retired;\n";
+            os << "    m.stack.push(m.PC);\n";
+            os << "    Instructions::AssignV<uint64_t, uint16_t>(&m.PC, " << Hex(p.NNN) << ");\n";
+            return false;
+        case Kind::Return:
+            os << "    ++m.retired;\n";
+            os << "    if (m.stack.size() == 0) return;\n";
+            os << "    Instructions::AssignV<uint64_t, uint16_t>(&m.PC, m.stack.top());\n";
+            os << "    m.stack.pop();\n";
+            return false;
+        case Kind::Skip:
+        {
+            std::string cond;
+            switch (op >> 12)
+            {
+            case 0x3: cond = "m.V[" + X + "] == " + Hex(p.NN, 2); break;
+            case 0x4: cond = "m.V[" + X + "] != " + Hex(p.NN, 2); break;
+            case 0x5: cond = "m.V[" + X + "] == m.V[" + Y + "]"; break;
+            case 0x9: cond = "m.V[" + X + "] != m.V[" + Y + "]"; break;
+            }
+            os << "    ++m.retired;\n";
+            if (!SkipsJump(addr))
+            {
+                os << "    Instructions::SkipNext(&m.PC, (" << cond << "));\n";
+                return false;
+            }
+
+            // A skip over a jump is a two way branch: leave on the skip, go on with the jump
+            os << "    if (" << cond << ") { m.PC = " << Hex(addr + 4) << "; return; }\n";
+            return true;
+        }
+        case Kind::Computed:
+            os << "    ++m.retired;\n";
+            os << "    Instructions::Jump(&m.PC, " << Hex(p.NNN) << " + m.V[0]);\n";
+            return false;
+        case Kind::Invalid:
+            return false;
+        case Kind::Native:
+            break;
+        }
+
+        os << "    ++m.retired;\n";
+        switch (op >> 12)
+        {
+        case 0x6: os << "    Instructions::AssignV<uint8_t, uint8_t>(&m.V[" << X << "], " << Hex(p.NN, 2) << ");\n"; break;
+        case 0x7: os << "    Instructions::AddV<uint8_t, uint8_t>(&m.V[" << X << "], " << Hex(p.NN, 2) << ", nullptr);\n"; break;
+        case 0xa: os << "    Instructions::AssignV<uint16_t, uint16_t>(&m.I, " << Hex(p.NNN) << ");\n"; break;
+        case 0x8:
+            switch (p.N)
+            {
+            case 0x0: os << "    Instructions::Assign<uint8_t, uint8_t>(&m.V[" << X << "], &m.V[" << Y << "]);\n"; break;
+            case 0x1: os << "    Instructions::AssignV<uint8_t, uint8_t>(&m.V[" << X << "], m.V[" << X << "] | m.V[" << Y << "]);\n    m.V[0xf] = 0;\n"; break;
+            case 0x2: os << "    Instructions::AssignV<uint8_t, uint8_t>(&m.V[" << X << "], m.V[" << X << "] & m.V[" << Y << "]);\n    m.V[0xf] = 0;\n"; break;
+            case 0x3: os << "    Instructions::AssignV<uint8_t, uint8_t>(&m.V[" << X << "], m.V[" << X << "] ^ m.V[" << Y << "]);\n    m.V[0xf] = 0;\n"; break;
+            case 0x4: os << "    Instructions::Add<uint8_t, uint8_t>(&m.V[" << X << "], &m.V[" << Y << "], &m.V[0xf]);\n"; break;
+            case 0x5: os << "    Instructions::Sub<uint8_t, uint8_t>(&m.V[" << X << "], &m.V[" << Y << "], &m.V[0xf]);\n"; break;
+            case 0x6: os << "    m.V[" << X << "] = (uint8_t)m.V[" << Y << "];\n    Instructions::RShiftV<uint8_t, uint8_t>(&m.V[" << X << "], 1, &m.V[0xf]);\n"; break;
+            case 0x7: os << "    Instructions::SubVAlt<uint8_t, uint8_t>(&m.V[" << X << "], m.V[" << Y << "], &m.V[0xf]);\n"; break;
+            case 0xe: os << "    m.V[" << X << "] = (uint8_t)m.V[" << Y << "];\n    Instructions::LShiftV<uint8_t, uint8_t>(&m.V[" << X << "], 1, &m.V[0xf]);\n"; break;
+            }
+            break;
+        case 0xf:
+            switch (p.NN)
+            {
+            case 0x07: os << "    Instructions::AssignV<uint8_t, uint8_t>(&m.V[" << X << "], m.GetDelayTimer());\n"; break;
+            case 0x1e: os << "    Instructions::AddV<uint16_t, uint8_t>(&m.I, m.V[" << X << "], nullptr);\n"; break;
+            case 0x29: os << "    m.I = M::MEMORY_FONTS + ((uint8_t)m.V[" << X << "] * 5);\n"; break;
+            case 0x33: os << "    Instructions::BCD(m.ram, m.V[" << X << "], m.I);\n"; break;
+            case 0x55: os << "    Instructions::Store<M::MemorySpecs, uint8_t, uint8_t, 16>(m.ram, m.I, " << X << ", &m.V);\n    m.I += " << p.X + 1 << ";\n"; break;
+            case 0x65: os << "    Instructions::Fill<M::MemorySpecs, uint8_t, uint8_t, 16>(m.ram, m.I, " << X << ", &m.V);\n    m.I += " << p.X + 1 << ";\n"; break;
+            }
+            break;
+        }
+        return !WritesMemory(op);
+    }
+
+    void Emit(std::ostream & os, const std::string & source) const
+    {
+        os << "// Generated by chip8-aot from " << source << ". Do not edit.\n\n";
+        os << "#include \"src/aot.h\"\n\n";
+        os << "namespace\n{\n\n";
+        os << "typedef CHIP8AOT<HeadlessBackend> M;\n\n";
+
+        os << "const uint8_t rom[] = {";
+        for (std::size_t i=0; i<rom.size(); ++i)
+            os << (i % 16 ? " " : "\n    ") << Hex(rom[i], 2) << ",";
+        os << "\n};\n\n";
+
+        std::vector<std::string> table;
+        for (auto leader : leaders)
+        {
+            if (!reachable.count(leader))
+                continue;
+
+            std::stringstream body;
+            uint16_t addr = leader;
+            uint16_t count = 0;
+            bool go_on = true;
+            while (go_on)
+            {
+                // The runtime only checks the pages of the first and last byte of a block, so
+                // a block may spill over into the next page with its last instruction only
+                if (Ram::Page(addr) != Ram::Page(leader))
+                    break;
+
+                const auto op = OpAt(addr);
+                if (Classify(op) == Kind::Invalid)
+                    break;
+
+                go_on = EmitOp(body, addr, op);
+                addr += 2;
+                ++count;
+
+                // Falls through into the next block, except for the jump a skip branches around
+                const bool skipped = Classify(op) == Kind::Skip;
+                if (go_on && !skipped && (leaders.count(addr) || !reachable.count(addr)))
+                    break;
+            }
+
+            if (!count)
+                continue;
+
+            os << "void B_" << std::hex << leader << "(M & m)\n{\n" << body.str() << "}\n\n";
+
+            std::stringstream entry;
+            entry << "    { " << Hex(leader) << ", " << std::dec << (addr - leader) << ", " << count << ", B_" << std::hex << leader << " },";
+            table.push_back(entry.str());
+        }
+
+        os << "const M::Block blocks[] = {\n";
+        for (auto & t : table)
+            os << t << "\n";
+        os << "};\n\n";
+        os << "}\n\n";
+
+        os << "int main(int argc, char* argv[])\n{\n";
+        os << "    return AOTMain(rom, sizeof(rom), blocks, std::size(blocks), argc, argv);\n";
+        os << "}\n";
+    }
+
+    std::size_t Reachable() const { return reachable.size(); };
+    std::size_t Leaders() const { return leaders.size(); };
+};
+
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 3) {
+        std::cerr << "Translates a ROM to C++ ahead of time." << std::endl;
+        std::cerr << "EX:" << std::endl;
+        std::cerr << argv[0] << " [ROMFILE.ch8] [OUTPUT.cpp]" << std::endl;
+        std::cerr << std::endl;
+        return 1;
+    }
+
+    std::ifstream is(argv[1], std::ios::in | std::ios::binary);
+    if (!is.is_open()) {
+        std::cerr << "Error loading ROM " << argv[1] << "\n";
+        return 1;
+    }
+    std::vector<uint8_t> rom{std::istreambuf_iterator<char>(is), std::istreambuf_iterator<char>()};
+
+    Translator t(std::move(rom));
+    t.Explore();
+
+    std::ofstream os(argv[2]);
+    if (!os.is_open()) {
+        std::cerr << "Error writing " << argv[2] << "\n";
+        return 1;
+    }
+    t.Emit(os, argv[1]);
+
+    std::cout << "Translated " << t.Reachable() << " reachable instructions in " << t.Leaders() << " blocks\n";
+    return 0;
+}
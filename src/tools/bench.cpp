@@ -0,0 +1,237 @@
+// chip8-bench: runs ROMs headless at full speed and reports interpreter statistics.
+
+#include <chrono>
+#include <memory>
+#include <vector>
+#include <string>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+#include "src/machine.h"
+#include "src/headless.h"
+#include "src/pool.h"
+#include "src/anymachine.h"
+#include "src/alloc.h"
+#include "src/tools/corpus.h"
+
+namespace
+{
+
+typedef CHIP8Core<HeadlessBackend> Headless;
+
+struct Result
+{
+    uint64_t retired;
+    uint64_t dispatches;
+    double seconds;
+};
+
+std::unique_ptr<Headless> Run(const std::vector<uint8_t> & rom, bool fusion, unsigned int frames, unsigned int ipf, Result & r)
+{
+    auto m = std::make_unique<Headless>();
+    m->SetFusion(fusion);
+    m->LoadROM(rom.data(), rom.size());
+
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned int f=0; f<frames && m->IsRunning(); ++f)
+        m->RunFrame(ipf);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    r = Result{ m->GetRetired(), m->GetDispatches(), elapsed.count() };
+    return m;
+}
+
+// Same as Run(), through the type erased wrapper one instruction at a time: what every
+// instruction paid when the machine interfaces were virtual
+std::shared_ptr<AnyMachine> RunErased(const std::vector<uint8_t> & rom, unsigned int frames, unsigned int ipf, Result & r)
+{
+    auto m = MakeAnyMachine<Headless>();
+    m->LoadROM(rom.data(), rom.size());
+
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned int f=0; f<frames && m->IsRunning(); ++f)
+    {
+        const auto target = m->GetRetired() + ipf;
+        m->SetLimit(target);
+        while (m->GetRetired() < target && m->IsRunning() && !m->Suspended())
+            m->Task();
+        m->SetLimit(std::numeric_limits<uint64_t>::max());
+        m->TickTimers();
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    r = Result{ m->GetRetired(), m->GetDispatches(), elapsed.count() };
+    return m;
+}
+
+// Short episodes of `frames` frames on pooled machines. Returns false if a recycled machine
+// does not start from the same state as a freshly loaded one.
+bool Episodes(const std::vector<uint8_t> & rom, uint64_t episodes, unsigned int frames, unsigned int ipf)
+{
+    MachinePool<Headless> pool(1);
+    pool.LoadROM(rom.data(), rom.size());
+
+    Headless fresh;
+    fresh.LoadROM(rom.data(), rom.size());
+
+    bool same = true;
+    auto start = std::chrono::steady_clock::now();
+    for (uint64_t e=0; e<episodes; ++e)
+    {
+        auto m = pool.Acquire();
+        same = same && (e != 1 || (m->SameState(fresh) && m->StateHash() == fresh.StateHash()));
+        for (unsigned int f=0; f<frames && m->IsRunning(); ++f)
+            m->RunFrame(ipf);
+        pool.Release(m);
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    std::cout << "  episodes: " << episodes << " of " << frames << " frames"
+              << " episodes/s=" << uint64_t(episodes / elapsed.count())
+              << " pages/reset=" << std::fixed << std::setprecision(2) << double(pool.GetRestoredPages()) / std::max<uint64_t>(pool.GetResets(), 1)
+              << (same ? "" : " (RESET STATE DIFFERS)") << "\n";
+    return same;
+}
+
+// Heap allocations once the machine is warm: the first frames fill the decode cache and the
+// call stack, after that running a frame must not allocate. Returns false if one did.
+bool Allocations(const std::vector<uint8_t> & rom, unsigned int frames, unsigned int ipf)
+{
+    const unsigned int warmup = 60;
+
+    auto m = std::make_unique<Headless>();
+    m->LoadROM(rom.data(), rom.size());
+    for (unsigned int f=0; f<warmup && m->IsRunning(); ++f)
+        m->RunFrame(ipf);
+
+    unsigned int measured = 0;
+    Alloc::Clear();
+    Alloc::Enable(1);
+    for (; measured<frames && m->IsRunning(); ++measured)
+        m->RunFrame(ipf);
+    Alloc::Disable();
+
+    const auto n = Alloc::Allocations();
+    std::cout << "  steady state allocations per frame=" << double(n) / std::max(measured, 1u)
+              << " (" << n << " in " << measured << " frames)\n";
+    if (n)
+        Alloc::Report(std::cout);
+    return n == 0;
+}
+
+// The frames again under the COSMAC VIP timing model (see vip.h): the speed it gives the ROM,
+// with no ipf to tune. Returns false if two runs do not end in the same state.
+bool VipTiming(const std::vector<uint8_t> & rom, unsigned int frames)
+{
+    auto a = std::make_unique<Headless>(), b = std::make_unique<Headless>();
+    for (auto & m : { a.get(), b.get() })
+    {
+        m->SetTiming(Headless::Timing::VIP);
+        m->LoadROM(rom.data(), rom.size());
+        for (unsigned int f=0; f<frames && m->IsRunning(); ++f)
+            m->RunFrame(0);
+    }
+
+    const bool same = a->SameState(*b);
+    std::cout << "  vip timing: instructions/frame=" << std::fixed << std::setprecision(1) << double(a->GetRetired()) / std::max(frames, 1u)
+              << " instructions/s=" << std::setprecision(0) << 60.0 * a->GetRetired() / std::max(frames, 1u)
+              << (same ? "" : " (RUNS DIFFER)") << std::defaultfloat << "\n";
+    return same;
+}
+
+void Print(const char * name, const Result & r)
+{
+    std::cout << "  " << name << std::dec
+              << " instructions=" << r.retired
+              << " dispatches=" << r.dispatches
+              << " IPS=" << uint64_t(r.retired / r.seconds) << "\n";
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+    unsigned int frames = 600;
+    unsigned int ipf = 1000;
+    uint64_t episodes = 0;
+    unsigned int episode_frames = 10;
+    bool allocs = false;
+    bool erased = false;
+    bool vip = false;
+    std::vector<std::filesystem::path> corpus;
+
+    for (auto i=1; i<argc; ++i)
+    {
+        const std::string arg{argv[i]};
+        if (arg == "--frames" && i + 1 < argc)
+            frames = std::stoul(argv[++i]);
+        else if (arg == "--ipf" && i + 1 < argc)
+            ipf = std::stoul(argv[++i]);
+        else if (arg == "--allocs")
+            allocs = true;
+        else if (arg == "--erased")
+            erased = true;
+        else if (arg == "--vip")
+            vip = true;
+        else if (arg == "--episodes" && i + 1 < argc)
+            episodes = std::stoull(argv[++i]);
+        else if (arg == "--episode-frames" && i + 1 < argc)
+            episode_frames = std::stoul(argv[++i]);
+        else
+            AddToCorpus(corpus, arg);
+    }
+
+    if (corpus.empty()) {
+        std::cerr << "Please specify ROMs or directories to run." << std::endl;
+        std::cerr << "EX:" << std::endl;
+        std::cerr << argv[0] << " [--frames N] [--ipf N] [--allocs] [--erased] [--vip] [--episodes N] [--episode-frames N] [ROMFILE.ch8|DIR]..." << std::endl;
+        std::cerr << std::endl;
+        return 1;
+    }
+
+    Result total_off{}, total_on{};
+    int failures = 0;
+    for (auto & path : corpus)
+    {
+        auto rom = ReadROM(path);
+        if (rom.empty() || rom.size() > Headless::MemorySpecs::Size - Headless::MEMORY_USABLE)
+            continue;
+
+        Result off, on;
+        auto plain = Run(rom, false, frames, ipf, off);
+        auto fused = Run(rom, true, frames, ipf, on);
+        const bool same = plain->SameState(*fused);
+        failures += !same;
+
+        std::cout << path.string() << (same ? "" : " (STATE DIFFERS WITH FUSION)") << "\n";
+        Print("fusion off:", off);
+        Print("fusion on: ", on);
+        if (erased)
+        {
+            Result e;
+            CHIP8State a, b;
+            RunErased(rom, frames, ipf, e)->SaveState(a);
+            fused->SaveState(b);
+            failures += !(a == b);
+            Print(a == b ? "type erased:" : "type erased (STATE DIFFERS):", e);
+        }
+        if (vip)
+            failures += !VipTiming(rom, frames);
+        if (allocs)
+            failures += !Allocations(rom, frames, ipf);
+        if (episodes)
+            failures += !Episodes(rom, episodes, episode_frames, ipf);
+
+        total_off = Result{ total_off.retired + off.retired, total_off.dispatches + off.dispatches, total_off.seconds + off.seconds };
+        total_on = Result{ total_on.retired + on.retired, total_on.dispatches + on.dispatches, total_on.seconds + on.seconds };
+    }
+
+    std::cout << "corpus\n";
+    Print("fusion off:", total_off);
+    Print("fusion on: ", total_on);
+    std::cout << "  dispatch reduction: " << std::fixed << std::setprecision(1)
+              << 100.0 * (1.0 - double(total_on.dispatches) / std::max<uint64_t>(total_off.dispatches, 1)) << "%\n";
+
+    return failures ? 1 : 0;
+}
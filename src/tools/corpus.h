@@ -0,0 +1,29 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <fstream>
+#include <iterator>
+#include <filesystem>
+
+// Helpers shared by the command line tools working on sets of ROMs
+
+inline std::vector<uint8_t> ReadROM(const std::filesystem::path & path)
+{
+    std::ifstream is(path, std::ios::in | std::ios::binary);
+    return std::vector<uint8_t>{std::istreambuf_iterator<char>(is), std::istreambuf_iterator<char>()};
+}
+
+// Adds a ROM file, or every file below a directory, to the corpus
+inline void AddToCorpus(std::vector<std::filesystem::path> & corpus, const std::string & arg)
+{
+    if (std::filesystem::is_directory(arg))
+    {
+        for (auto & e : std::filesystem::recursive_directory_iterator(arg))
+            if (e.is_regular_file())
+                corpus.push_back(e.path());
+    }
+    else
+        corpus.push_back(arg);
+}
@@ -0,0 +1,125 @@
+// chip8-envc: load generator for chip8-envd. Resets every environment, then sends batched
+// steps with random actions, resetting the environments that report done. Prints round trip
+// latency percentiles and the server side batch step latencies.
+
+#include <chrono>
+#include <random>
+#include <vector>
+#include <string>
+#include <iostream>
+#include <algorithm>
+
+#include <sys/un.h>
+#include <sys/socket.h>
+
+#include "src/envd.h"
+
+namespace
+{
+
+bool Request(int fd, Env::Type type, const void * records, std::size_t count, std::size_t record_size, Env::Header & reply)
+{
+    Env::Header h{ Env::MAGIC, type, Env::OK, uint32_t(count) };
+    return Env::WriteAll(fd, &h, sizeof(h)) && Env::WriteAll(fd, records, count * record_size)
+        && Env::ReadAll(fd, &reply, sizeof(reply)) && reply.magic == Env::MAGIC && reply.status == Env::OK;
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+    std::string path = "/tmp/chip8-envd.sock";
+    unsigned int envs = 16;
+    unsigned int steps = 1000;
+
+    for (auto i=1; i<argc; ++i)
+    {
+        const std::string arg{argv[i]};
+        const bool has_value = i + 1 < argc;
+        if (arg == "--socket" && has_value)
+            path = argv[++i];
+        else if (arg == "--envs" && has_value)
+            envs = std::max(1ul, std::stoul(argv[++i]));
+        else if (arg == "--steps" && has_value)
+            steps = std::stoul(argv[++i]);
+        else {
+            std::cerr << "Please specify the server and its number of environments." << std::endl;
+            std::cerr << "EX:" << std::endl;
+            std::cerr << argv[0] << " [--socket PATH] [--envs N] [--steps N]" << std::endl;
+            std::cerr << std::endl;
+            return 1;
+        }
+    }
+
+    const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    std::copy(path.begin(), path.begin() + std::min(path.size(), sizeof(addr.sun_path) - 1), addr.sun_path);
+    if (fd < 0 || connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr))) {
+        std::cerr << "Error connecting to " << path << "\n";
+        return 1;
+    }
+
+    std::vector<uint8_t> flags(envs, 1);
+    std::vector<uint16_t> actions(envs);
+    std::vector<Env::Observation> obs(envs);
+    std::vector<uint64_t> latencies;
+    std::mt19937 rng(1);
+    Env::Header reply;
+    int64_t reward = 0;
+    uint64_t episodes = 0;
+
+    if (!Request(fd, Env::RESET, flags.data(), envs, 1, reply) || !Env::ReadAll(fd, obs.data(), envs * sizeof(Env::Observation))) {
+        std::cerr << "Reset failed, does the server host " << envs << " environments?\n";
+        return 1;
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    for (unsigned int s=0; s<steps; ++s)
+    {
+        for (auto & a : actions)
+            a = (rng() % 4) ? 0 : (1 << (rng() % 16));
+
+        const auto t0 = std::chrono::steady_clock::now();
+        if (!Request(fd, Env::STEP, actions.data(), envs, sizeof(uint16_t), reply) || !Env::ReadAll(fd, obs.data(), envs * sizeof(Env::Observation))) {
+            std::cerr << "Step failed\n";
+            return 1;
+        }
+        latencies.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0).count());
+
+        bool any_done = false;
+        for (unsigned int e=0; e<envs; ++e)
+        {
+            reward += obs[e].reward;
+            flags[e] = obs[e].done;
+            any_done = any_done || obs[e].done;
+        }
+
+        if (any_done)
+        {
+            episodes += std::count(flags.begin(), flags.end(), 1);
+            if (!Request(fd, Env::RESET, flags.data(), envs, 1, reply) || !Env::ReadAll(fd, obs.data(), envs * sizeof(Env::Observation))) {
+                std::cerr << "Reset failed\n";
+                return 1;
+            }
+        }
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    Env::Stats server;
+    if (!Request(fd, Env::STATS, nullptr, 0, 0, reply) || !Env::ReadAll(fd, &server, sizeof(server))) {
+        std::cerr << "Stats failed\n";
+        return 1;
+    }
+    close(fd);
+
+    std::sort(latencies.begin(), latencies.end());
+    auto at = [&latencies](double p) { return latencies.empty() ? 0 : latencies[std::min(latencies.size() - 1, std::size_t(p * latencies.size()))] / 1000.0; };
+
+    std::cout << steps << " batched steps of " << envs << " envs in " << elapsed.count() << "s ("
+              << uint64_t(steps * envs / elapsed.count()) << " env steps/s), " << episodes << " episodes done, total reward " << reward << "\n";
+    std::cout << "round trip us: p50=" << at(0.5) << " p90=" << at(0.9) << " p99=" << at(0.99) << " max=" << at(1.0) << "\n";
+    std::cout << "server step us: p50=" << server.p50_ns / 1000.0 << " p90=" << server.p90_ns / 1000.0
+              << " p99=" << server.p99_ns / 1000.0 << " max=" << server.max_ns / 1000.0 << "\n";
+    return 0;
+}
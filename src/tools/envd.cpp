@@ -0,0 +1,411 @@
+// chip8-envd: hosts N machines running the same ROM and serves batched reset/step requests
+// over a Unix domain socket (wire format in src/envd.h). Steps of a batch run in parallel on a
+// fixed set of worker threads. Clients are served one at a time.
+
+#include <array>
+#include <cmath>
+#include <mutex>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <csignal>
+#include <iostream>
+#include <algorithm>
+#include <functional>
+#include <condition_variable>
+
+#include <sys/un.h>
+#include <sys/socket.h>
+
+#include "src/envd.h"
+#include "src/libchip8.h"
+#include "src/tools/corpus.h"
+
+namespace
+{
+
+struct Options
+{
+    std::string socket = "/tmp/chip8-envd.sock";
+    std::string rom;
+    unsigned int envs = 16;
+    unsigned int threads = std::max(1u, std::thread::hardware_concurrency());
+    unsigned int ipf = 12;
+    unsigned int frames_per_step = 4;
+    uint64_t max_frames = 0;                    // Episode length, 0 = no limit
+    int reward_addr = -1;                       // Score location, big endian
+    unsigned int reward_bytes = 1;
+    int done_addr = -1;                         // Game over when RAM[done_addr] == done_value
+    uint8_t done_value = 0;
+};
+
+struct Environment
+{
+    std::unique_ptr<chip8_t, decltype(&chip8_destroy)> m{nullptr, chip8_destroy};
+    const uint8_t * ram = nullptr;
+    uint64_t frames = 0;
+    int64_t score = 0;
+};
+
+// Persistent workers running one function over [0, n) in contiguous slices
+class Workers
+{
+    std::vector<std::thread> threads;
+    std::mutex lock;
+    std::condition_variable cv;
+    std::function<void(std::size_t, std::size_t)> job;
+    std::size_t items = 0;
+    uint64_t generation = 0;
+    unsigned int pending = 0;
+    bool closing = false;
+
+    void Loop(unsigned int id)
+    {
+        uint64_t seen = 0;
+        std::unique_lock<std::mutex> guard(lock);
+        while (true)
+        {
+            cv.wait(guard, [&]() { return closing || generation != seen; });
+            if (closing)
+                return;
+            seen = generation;
+
+            const auto slice = (items + threads.size() - 1) / threads.size();
+            const auto first = std::min(items, id * slice);
+            const auto last = std::min(items, first + slice);
+            guard.unlock();
+            if (first < last)
+                job(first, last);
+            guard.lock();
+
+            if (--pending == 0)
+                cv.notify_all();
+        }
+    }
+
+public:
+    Workers(unsigned int count)
+    {
+        for (unsigned int t=0; t<count; ++t)
+            threads.emplace_back(&Workers::Loop, this, t);
+    }
+
+    ~Workers()
+    {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            closing = true;
+        }
+        cv.notify_all();
+        for (auto & t : threads)
+            t.join();
+    }
+
+    void Run(std::size_t n, const std::function<void(std::size_t, std::size_t)> & fn)
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        job = fn;
+        items = n;
+        pending = threads.size();
+        ++generation;
+        cv.notify_all();
+        cv.wait(guard, [this]() { return pending == 0; });
+    }
+};
+
+// Log bucketed histogram: 8 buckets per power of two, so percentiles are within 12.5% and the
+// memory is fixed however long the server runs
+class Histogram
+{
+    static const unsigned int SUB = 8;
+
+    std::array<uint64_t, 64 * SUB> buckets{};
+    uint64_t count = 0;
+    uint64_t max = 0;
+
+    static std::size_t Bucket(uint64_t v)
+    {
+        if (v < SUB)
+            return v;
+        const unsigned int log = 63 - __builtin_clzll(v);
+        return (log - 2) * SUB + ((v >> (log - 3)) & (SUB - 1));
+    }
+
+    // Largest value that falls in a bucket
+    static uint64_t Upper(std::size_t b)
+    {
+        if (b < SUB)
+            return b;
+        const unsigned int log = b / SUB + 2;
+        return ((SUB + b % SUB + 1) << (log - 3)) - 1;
+    }
+
+public:
+    void Add(uint64_t v)
+    {
+        ++buckets[Bucket(v)];
+        ++count;
+        max = std::max(max, v);
+    }
+
+    uint64_t Count() const { return count; };
+    uint64_t Max() const { return max; };
+
+    // Upper bound of the bucket holding the `p` quantile
+    uint64_t Percentile(double p) const
+    {
+        const uint64_t rank = std::max<uint64_t>(1, uint64_t(std::ceil(p * count)));
+        uint64_t seen = 0;
+        for (std::size_t b=0; b<buckets.size(); ++b)
+        {
+            seen += buckets[b];
+            if (seen >= rank)
+                return std::min(Upper(b), max);
+        }
+        return max;
+    }
+};
+
+class Server
+{
+    const Options & opt;
+    std::vector<uint8_t> rom;
+    std::vector<Environment> envs;
+    std::vector<Env::Observation> replies;
+    std::vector<uint16_t> actions;
+    std::vector<uint8_t> flags;
+    Workers workers;
+    Histogram latencies;                        // Nanoseconds per STEP
+
+    int64_t Score(const Environment & e) const
+    {
+        if (opt.reward_addr < 0)
+            return 0;
+
+        int64_t v = 0;
+        for (unsigned int b=0; b<opt.reward_bytes; ++b)
+            v = (v << 8) | e.ram[(opt.reward_addr + b) & 0xfff];
+        return v;
+    }
+
+    void Observe(Environment & e, Env::Observation & o)
+    {
+        std::size_t size = 0;
+        auto video = chip8_get_framebuffer(e.m.get(), &size);
+        std::copy(video, video + size, o.video);
+
+        const auto score = Score(e);
+        o.reward = int32_t(score - e.score);
+        e.score = score;
+
+        o.done = !chip8_is_running(e.m.get())
+              || (opt.max_frames && e.frames >= opt.max_frames)
+              || (opt.done_addr >= 0 && e.ram[opt.done_addr & 0xfff] == opt.done_value);
+        std::fill(o.pad, o.pad + sizeof(o.pad), 0);
+    }
+
+    void Reset(Environment & e)
+    {
+        chip8_reset(e.m.get());
+        e.frames = 0;
+        e.score = Score(e);
+    }
+
+public:
+    Server(const Options & o, std::vector<uint8_t> && r) : opt{o}, rom{std::move(r)}, envs(o.envs), replies(o.envs),
+                                                          actions(o.envs), flags(o.envs), workers(o.threads)
+    {
+        for (auto & e : envs)
+        {
+            e.m.reset(chip8_create());
+            chip8_load_rom_from_memory(e.m.get(), rom.data(), rom.size());
+            e.ram = chip8_get_ram(e.m.get(), nullptr);
+            e.score = Score(e);
+        }
+    }
+
+    bool Handle(int fd)
+    {
+        Env::Header h;
+        if (!Env::ReadAll(fd, &h, sizeof(h)))
+            return false;
+
+        Env::Header reply{ Env::MAGIC, h.type, Env::OK, 0 };
+        const bool batched = h.type == Env::RESET || h.type == Env::STEP;
+        if (h.magic != Env::MAGIC || (batched && h.count != envs.size()) || (!batched && h.type != Env::STATS))
+        {
+            reply.status = Env::BAD_REQUEST;
+            return Env::WriteAll(fd, &reply, sizeof(reply)) && false;
+        }
+
+        if (h.type == Env::RESET)
+        {
+            if (!Env::ReadAll(fd, flags.data(), flags.size()))
+                return false;
+
+            workers.Run(envs.size(), [this](std::size_t first, std::size_t last)
+            {
+                for (auto i=first; i<last; ++i)
+                {
+                    if (flags[i])
+                        Reset(envs[i]);
+                    Observe(envs[i], replies[i]);
+                }
+            });
+        }
+        else if (h.type == Env::STEP)
+        {
+            if (!Env::ReadAll(fd, actions.data(), actions.size() * sizeof(uint16_t)))
+                return false;
+
+            const auto start = std::chrono::steady_clock::now();
+            workers.Run(envs.size(), [this](std::size_t first, std::size_t last)
+            {
+                for (auto i=first; i<last; ++i)
+                {
+                    auto & e = envs[i];
+                    chip8_set_keys(e.m.get(), actions[i]);
+                    chip8_step_frames(e.m.get(), opt.frames_per_step, opt.ipf);
+                    e.frames += opt.frames_per_step;
+                    Observe(e, replies[i]);
+                }
+            });
+            latencies.Add(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+        }
+        else
+        {
+            const auto stats = GetStats();
+            reply.count = 1;
+            return Env::WriteAll(fd, &reply, sizeof(reply)) && Env::WriteAll(fd, &stats, sizeof(stats));
+        }
+
+        reply.count = envs.size();
+        return Env::WriteAll(fd, &reply, sizeof(reply)) && Env::WriteAll(fd, replies.data(), replies.size() * sizeof(Env::Observation));
+    }
+
+    Env::Stats GetStats() const
+    {
+        Env::Stats s{ latencies.Count(), 0, 0, 0, 0 };
+        if (!latencies.Count())
+            return s;
+
+        s.p50_ns = latencies.Percentile(0.50);
+        s.p90_ns = latencies.Percentile(0.90);
+        s.p99_ns = latencies.Percentile(0.99);
+        s.max_ns = latencies.Max();
+        return s;
+    }
+
+    void Report(std::ostream & os) const
+    {
+        const auto s = GetStats();
+        os << envs.size() << " envs, " << s.steps << " steps, batch step latency us:"
+           << " p50=" << s.p50_ns / 1000.0 << " p90=" << s.p90_ns / 1000.0
+           << " p99=" << s.p99_ns / 1000.0 << " max=" << s.max_ns / 1000.0 << std::endl;
+    }
+};
+
+// Parses ADDR[:N] and ADDR=VALUE, addresses in hex
+int ParseAddr(const std::string & s, char sep, unsigned int & extra)
+{
+    const auto pos = s.find(sep);
+    if (pos != std::string::npos)
+        extra = std::stoul(s.substr(pos + 1), nullptr, 0);
+    return std::stoul(s.substr(0, pos), nullptr, 16);
+}
+
+volatile std::sig_atomic_t quit = 0;
+
+}
+
+int main(int argc, char* argv[])
+{
+    Options opt;
+
+    for (auto i=1; i<argc; ++i)
+    {
+        const std::string arg{argv[i]};
+        const bool has_value = i + 1 < argc;
+        if (arg == "--socket" && has_value)
+            opt.socket = argv[++i];
+        else if (arg == "--envs" && has_value)
+            opt.envs = std::max(1ul, std::stoul(argv[++i]));
+        else if (arg == "--threads" && has_value)
+            opt.threads = std::max(1ul, std::stoul(argv[++i]));
+        else if (arg == "--ipf" && has_value)
+            opt.ipf = std::stoul(argv[++i]);
+        else if (arg == "--frames-per-step" && has_value)
+            opt.frames_per_step = std::max(1ul, std::stoul(argv[++i]));
+        else if (arg == "--max-frames" && has_value)
+            opt.max_frames = std::stoull(argv[++i]);
+        else if (arg == "--reward" && has_value)
+            opt.reward_addr = ParseAddr(argv[++i], ':', opt.reward_bytes);
+        else if (arg == "--done" && has_value)
+        {
+            unsigned int value = 0;
+            opt.done_addr = ParseAddr(argv[++i], '=', value);
+            opt.done_value = value;
+        }
+        else
+            opt.rom = arg;
+    }
+
+    if (opt.rom.empty()) {
+        std::cerr << "Please specify a ROM to serve." << std::endl;
+        std::cerr << "EX:" << std::endl;
+        std::cerr << argv[0] << " [--socket PATH] [--envs N] [--threads N] [--ipf N] [--frames-per-step N] [--max-frames N]"
+                  << " [--reward ADDR[:BYTES]] [--done ADDR=VALUE] [ROMFILE.ch8]" << std::endl;
+        std::cerr << std::endl;
+        return 1;
+    }
+
+    auto rom = ReadROM(opt.rom);
+    if (rom.empty() || rom.size() > 0xe00) {
+        std::cerr << "Error loading ROM " << opt.rom << "\n";
+        return 1;
+    }
+    opt.reward_bytes = std::clamp(opt.reward_bytes, 1u, 4u);
+
+    const int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (listener < 0 || opt.socket.size() >= sizeof(addr.sun_path)) {
+        std::cerr << "Error creating socket " << opt.socket << "\n";
+        return 1;
+    }
+    std::copy(opt.socket.begin(), opt.socket.end(), addr.sun_path);
+    unlink(opt.socket.c_str());
+    if (bind(listener, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) || listen(listener, 1)) {
+        std::cerr << "Error listening on " << opt.socket << "\n";
+        return 1;
+    }
+
+    // accept() is interrupted instead of restarted, so the server can report and clean up
+    struct sigaction sa{};
+    sa.sa_handler = [](int) { quit = 1; };
+    sigaction(SIGINT, &sa, nullptr);
+    sigaction(SIGTERM, &sa, nullptr);
+    std::signal(SIGPIPE, SIG_IGN);
+
+    Server server(opt, std::move(rom));
+    std::cout << "Serving " << opt.envs << " environments on " << opt.socket << std::endl;
+
+    while (!quit)
+    {
+        const int fd = accept(listener, nullptr, nullptr);
+        if (fd < 0)
+            continue;
+
+        while (!quit && server.Handle(fd))
+            ;
+        close(fd);
+        server.Report(std::cout);
+    }
+
+    close(listener);
+    unlink(opt.socket.c_str());
+    server.Report(std::cout);
+    return 0;
+}
@@ -0,0 +1,430 @@
+// chip8-explore: breadth of reachable states of a ROM. Every state is forked once per input
+// (each of the 16 keys and "no key") and run for one frame. New states are deduplicated by
+// their execution hash, which unlike the state hash tells apart states with different RNGs;
+// states that executed ROM instructions nobody had reached before go first. Queued
+// states keep their RAM in a shared PageStore, as page IDs, so the frontier costs tens of bytes
+// per state plus whatever pages actually differ.
+
+#include <mutex>
+#include <deque>
+#include <array>
+#include <atomic>
+#include <bitset>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <string>
+#include <iomanip>
+#include <iostream>
+#include <unordered_set>
+
+#include "src/machine.h"
+#include "src/headless.h"
+#include "src/pagestore.h"
+#include "src/tools/corpus.h"
+
+namespace
+{
+
+typedef CHIP8Core<HeadlessBackend> Headless;
+typedef std::bitset<Headless::MemorySpecs::Size> Coverage;
+
+const unsigned int INPUTS = gInputTotalKeys + 1;   // Every key, then no key
+
+struct Options
+{
+    unsigned int ipf = 1000;
+    unsigned int threads = std::max(1u, std::thread::hardware_concurrency());
+    std::size_t max_frontier = 20000;
+    uint64_t max_states = 0;                    // 0 = no limit
+    double seconds = 10;
+    double report = 1;
+    std::size_t pages = 1 << 20;                // Page store capacity
+};
+
+// Releases its pages when expanded or dropped
+struct Node
+{
+    PagedState state;
+    uint32_t depth;
+    PageStore * store = nullptr;
+
+    ~Node()
+    {
+        if (store)
+            store->Release(state);
+    }
+};
+
+// Set of seen state hashes, sharded to keep lock contention low
+class Seen
+{
+    static const std::size_t SHARDS = 64;
+
+    struct Shard
+    {
+        std::mutex lock;
+        std::unordered_set<uint64_t> hashes;
+    };
+
+    std::array<Shard, SHARDS> shards;
+    std::atomic<uint64_t> count{0};
+
+public:
+    // True if the hash was not there yet
+    bool Insert(uint64_t hash)
+    {
+        auto & s = shards[hash % SHARDS];
+        std::lock_guard<std::mutex> guard(s.lock);
+        if (!s.hashes.insert(hash).second)
+            return false;
+        ++count;
+        return true;
+    }
+
+    uint64_t Size() const { return count; };
+};
+
+// ROM instructions executed by any worker, one bit per 2 byte slot of the ROM image. Code run
+// from the fonts or from RAM past the image is not counted.
+class GlobalCoverage
+{
+    static const std::size_t WORDS = Headless::MemorySpecs::Size / 2 / 64;
+    std::array<std::atomic<uint64_t>, WORDS> bits{};
+    std::atomic<uint64_t> count{0};
+    const std::size_t first, last;              // Addresses of the ROM image
+
+public:
+    GlobalCoverage(std::size_t rom_size) : first{Headless::MEMORY_USABLE}, last{Headless::MEMORY_USABLE + rom_size} { };
+
+    // Instruction slots of the ROM
+    std::size_t Slots() const { return (last - first + 1) / 2; };
+
+    // Merges a local bitmap, returning how many slots were new
+    unsigned int Merge(const Coverage & local)
+    {
+        std::array<uint64_t, WORDS> slots{};
+        for (auto a = first; a < last; ++a)
+            if (local[a])
+            {
+                const auto s = (a - first) / 2;
+                slots[s / 64] |= uint64_t(1) << (s % 64);
+            }
+
+        unsigned int fresh = 0;
+        for (std::size_t w=0; w<WORDS; ++w)
+        {
+            const auto word = slots[w];
+            if (word & ~bits[w].load(std::memory_order_relaxed))
+            {
+                const auto before = bits[w].fetch_or(word);
+                fresh += __builtin_popcountll(word & ~before);
+            }
+        }
+        count += fresh;
+        return fresh;
+    }
+
+    uint64_t Size() const { return count; };
+};
+
+// Work-stealing frontier. Each worker pushes and pops at the back of its own queues; idle
+// workers steal from the front of the others. States that found new code have their own queue
+// and are always taken first.
+class Frontier
+{
+    struct Queue
+    {
+        std::mutex lock;
+        std::deque<std::unique_ptr<Node>> fresh;    // Found new coverage
+        std::deque<std::unique_ptr<Node>> plain;
+    };
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::atomic<std::size_t> size{0};
+    std::atomic<std::size_t> busy{0};           // Nodes queued or being expanded
+    std::atomic<uint64_t> dropped{0};
+    const std::size_t max;
+
+public:
+    Frontier(unsigned int workers, std::size_t max_size) : max{max_size}
+    {
+        for (unsigned int w=0; w<workers; ++w)
+            queues.push_back(std::make_unique<Queue>());
+    }
+
+    // Keeps memory bounded: plain states are dropped first, states with new code only when
+    // the frontier is twice over its budget. False, counting the state as dropped, when a
+    // state of that kind would not be kept; checked before storing one.
+    bool Admit(bool is_fresh)
+    {
+        if (size < (is_fresh ? 2 * max : max))
+            return true;
+        ++dropped;
+        return false;
+    }
+
+    void Push(unsigned int worker, std::unique_ptr<Node> && n, bool is_fresh)
+    {
+        if (!Admit(is_fresh))
+            return;
+
+        auto & q = *queues[worker];
+        std::lock_guard<std::mutex> guard(q.lock);
+        (is_fresh ? q.fresh : q.plain).push_back(std::move(n));
+        ++size;
+        ++busy;
+    }
+
+    std::unique_ptr<Node> Pop(unsigned int worker)
+    {
+        auto take = [this](Queue & q, bool steal) -> std::unique_ptr<Node>
+        {
+            std::lock_guard<std::mutex> guard(q.lock);
+            for (auto d : { &q.fresh, &q.plain })
+            {
+                if (d->empty())
+                    continue;
+                std::unique_ptr<Node> n;
+                if (steal)
+                {
+                    n = std::move(d->front());
+                    d->pop_front();
+                }
+                else
+                {
+                    n = std::move(d->back());
+                    d->pop_back();
+                }
+                --size;
+                return n;
+            }
+            return nullptr;
+        };
+
+        if (auto n = take(*queues[worker], false))
+            return n;
+        for (std::size_t i=1; i<queues.size(); ++i)
+            if (auto n = take(*queues[(worker + i) % queues.size()], true))
+                return n;
+        return nullptr;
+    }
+
+    void Done() { --busy; };
+    bool Finished() const { return busy == 0; };
+    std::size_t Size() const { return size; };
+    uint64_t Dropped() const { return dropped; };
+};
+
+struct Stats
+{
+    std::atomic<uint64_t> expanded{0};          // Frames run
+    std::atomic<uint64_t> softlocks{0};         // States no input can change
+    std::atomic<uint32_t> depth{0};
+    std::atomic<uint64_t> stores{0};            // States put in the page store
+    std::atomic<uint64_t> store_ns{0};
+    std::atomic<uint64_t> restores{0};
+    std::atomic<uint64_t> restore_ns{0};
+    std::atomic<uint64_t> full{0};              // States lost to a full page store
+};
+
+uint64_t Since(std::chrono::steady_clock::time_point t)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t).count();
+}
+
+void Worker(unsigned int id, const std::vector<uint8_t> & rom, const Options & opt, Frontier & frontier, Seen & seen,
+            GlobalCoverage & covered, PageStore & store, Stats & stats, const std::atomic<bool> & stop)
+{
+    auto m = std::make_unique<Headless>();
+    m->LoadROM(rom.data(), rom.size());
+
+    CHIP8State parent_state, child_state;
+
+    Coverage local;
+    m->SetCoverage(&local);
+
+    while (!stop)
+    {
+        auto parent = frontier.Pop(id);
+        if (!parent)
+        {
+            if (frontier.Finished())
+                return;
+            std::this_thread::yield();
+            continue;
+        }
+
+        const auto restore_start = std::chrono::steady_clock::now();
+        store.Restore(parent->state, parent_state);
+        stats.restore_ns += Since(restore_start);
+        ++stats.restores;
+
+        const auto parent_hash = parent_state.Hash();
+        unsigned int unchanged = 0;
+
+        for (unsigned int input=0; input<INPUTS && !stop; ++input)
+        {
+            m->LoadState(parent_state);
+            m->GetInput().SetKeys(input < gInputTotalKeys ? (1 << input) : 0);
+
+            local.reset();
+            m->RunFrame(opt.ipf);
+            ++stats.expanded;
+
+            unchanged += (m->StateHash() == parent_hash);
+            if (!m->IsRunning() || !seen.Insert(m->ExecutionHash()))
+                continue;
+
+            const bool fresh = covered.Merge(local) > 0;
+            if (!frontier.Admit(fresh))
+                continue;
+
+            auto child = std::make_unique<Node>();
+            m->SaveState(child_state);
+            const auto store_start = std::chrono::steady_clock::now();
+            const bool stored = store.Store(child_state, child->state);
+            stats.store_ns += Since(store_start);
+            if (!stored)
+            {
+                ++stats.full;
+                continue;
+            }
+            ++stats.stores;
+            child->store = &store;
+            child->depth = parent->depth + 1;
+
+            auto depth = stats.depth.load();
+            while (child->depth > depth && !stats.depth.compare_exchange_weak(depth, child->depth))
+                ;
+
+            frontier.Push(id, std::move(child), fresh);
+        }
+
+        if (unchanged == INPUTS)
+            ++stats.softlocks;
+
+        frontier.Done();
+    }
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+    Options opt;
+    std::string rom_file;
+
+    for (auto i=1; i<argc; ++i)
+    {
+        const std::string arg{argv[i]};
+        const bool has_value = i + 1 < argc;
+        if (arg == "--ipf" && has_value)
+            opt.ipf = std::stoul(argv[++i]);
+        else if (arg == "--threads" && has_value)
+            opt.threads = std::max(1ul, std::stoul(argv[++i]));
+        else if (arg == "--max-frontier" && has_value)
+            opt.max_frontier = std::stoul(argv[++i]);
+        else if (arg == "--max-states" && has_value)
+            opt.max_states = std::stoull(argv[++i]);
+        else if (arg == "--seconds" && has_value)
+            opt.seconds = std::stod(argv[++i]);
+        else if (arg == "--report" && has_value)
+            opt.report = std::stod(argv[++i]);
+        else if (arg == "--pages" && has_value)
+            opt.pages = std::stoul(argv[++i]);
+        else
+            rom_file = arg;
+    }
+
+    if (rom_file.empty()) {
+        std::cerr << "Please specify a ROM to explore." << std::endl;
+        std::cerr << "EX:" << std::endl;
+        std::cerr << argv[0] << " [--ipf N] [--threads N] [--max-frontier N] [--max-states N] [--seconds S] [--report S] [--pages N] [ROMFILE.ch8]" << std::endl;
+        std::cerr << std::endl;
+        return 1;
+    }
+
+    auto rom = ReadROM(rom_file);
+    if (rom.empty() || rom.size() > Headless::MemorySpecs::Size - Headless::MEMORY_USABLE) {
+        std::cerr << "Error loading ROM " << rom_file << "\n";
+        return 1;
+    }
+
+    Seen seen;
+    GlobalCoverage covered(rom.size());
+    PageStore store(opt.pages);
+    Stats stats;
+    Frontier frontier(opt.threads, opt.max_frontier);
+    std::atomic<bool> stop{false};
+
+    {
+        auto root = std::make_unique<Node>();
+        Headless m;
+        m.LoadROM(rom.data(), rom.size());
+        CHIP8State s;
+        m.SaveState(s);
+        store.Store(s, root->state);
+        root->store = &store;
+        root->depth = 0;
+        seen.Insert(m.ExecutionHash());
+        frontier.Push(0, std::move(root), true);
+    }
+
+    const auto rom_instructions = covered.Slots();
+    auto start = std::chrono::steady_clock::now();
+    auto elapsed = [&start]() { return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count(); };
+
+    auto report = [&]()
+    {
+        const auto t = elapsed();
+        std::cout << std::fixed << std::setprecision(1) << "t=" << t << "s"
+                  << " states/s=" << uint64_t(stats.expanded / std::max(t, 1e-9))
+                  << " unique=" << seen.Size()
+                  << " coverage=" << covered.Size() << "/" << rom_instructions
+                  << " (" << 100.0 * covered.Size() / rom_instructions << "%)"
+                  << " frontier=" << frontier.Size()
+                  << " dropped=" << frontier.Dropped()
+                  << " depth=" << stats.depth
+                  << " softlocks=" << stats.softlocks << std::endl;
+    };
+
+    auto report_store = [&]()
+    {
+        const auto per_state = sizeof(PagedState) + double(store.GetUnique() * PageStore::PAGE_SIZE) / std::max<uint64_t>(stats.stores, 1);
+        std::cout << std::fixed << std::setprecision(1)
+                  << "Pages: " << store.GetUnique() << " stored, " << store.GetLive() << " live, " << store.GetRecycled() << " recycled, dedup ratio=" << store.DedupRatio()
+                  << ", snapshot=" << sizeof(PagedState) << " bytes + " << per_state - sizeof(PagedState) << " bytes of new pages"
+                  << " (" << sizeof(CHIP8State) << " flat)"
+                  << ", inserts/s=" << uint64_t(stats.stores * 1e9 / std::max<uint64_t>(stats.store_ns, 1))
+                  << " restores/s=" << uint64_t(stats.restores * 1e9 / std::max<uint64_t>(stats.restore_ns, 1));
+        if (stats.full)
+            std::cout << ", " << stats.full << " states lost to a full store";
+        std::cout << std::endl;
+    };
+
+    std::vector<std::thread> workers;
+    for (unsigned int t=0; t<opt.threads; ++t)
+        workers.emplace_back(Worker, t, std::cref(rom), std::cref(opt), std::ref(frontier), std::ref(seen),
+                             std::ref(covered), std::ref(store), std::ref(stats), std::cref(stop));
+
+    auto next_report = opt.report;
+    while (!frontier.Finished() && elapsed() < opt.seconds && (!opt.max_states || seen.Size() < opt.max_states))
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        if (elapsed() >= next_report)
+        {
+            report();
+            next_report += opt.report;
+        }
+    }
+
+    stop = true;
+    for (auto & w : workers)
+        w.join();
+
+    report();
+    report_store();
+    return 0;
+}
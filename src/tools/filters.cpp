@@ -0,0 +1,107 @@
+// chip8-filters: benchmarks the CPU upscaling filters (src/filter.h) on a moving test pattern
+// and prints the time per frame of each configuration.
+
+#include <chrono>
+#include <vector>
+#include <string>
+#include <random>
+#include <iomanip>
+#include <iostream>
+
+#include "src/filter.h"
+
+namespace
+{
+
+struct Config
+{
+    const char * name;
+    Filter::Options opt;
+};
+
+}
+
+int main(int argc, char* argv[])
+{
+    std::size_t width = 128;
+    std::size_t height = 64;
+    unsigned int scale = 10;
+    unsigned int frames = 500;
+
+    for (auto i=1; i<argc; ++i)
+    {
+        const std::string arg{argv[i]};
+        const bool has_value = i + 1 < argc;
+        if (arg == "--size" && has_value)
+        {
+            const std::string v{argv[++i]};
+            width = std::stoul(v);
+            height = std::stoul(v.substr(v.find('x') + 1));
+        }
+        else if (arg == "--scale" && has_value)
+            scale = std::max(1ul, std::stoul(argv[++i]));
+        else if (arg == "--frames" && has_value)
+            frames = std::max(1ul, std::stoul(argv[++i]));
+        else {
+            std::cerr << "Please specify the framebuffer size and the scale to benchmark." << std::endl;
+            std::cerr << "EX:" << std::endl;
+            std::cerr << argv[0] << " [--size WxH] [--scale N] [--frames N]" << std::endl;
+            std::cerr << std::endl;
+            return 1;
+        }
+    }
+    width = std::max<std::size_t>(8, width / 8 * 8);
+    height = std::max<std::size_t>(1, height);
+
+    auto make = [scale](Filter::Kind kind, bool scanlines, bool grid, uint8_t persistence)
+    {
+        Filter::Options o;
+        o.kind = kind;
+        o.scale = scale;
+        o.scanlines = scanlines;
+        o.grid = grid;
+        o.persistence = persistence;
+        return o;
+    };
+
+    const std::vector<Config> configs{
+        { "nearest", make(Filter::Kind::Nearest, false, false, 0) },
+        { "epx", make(Filter::Kind::EPX, false, false, 0) },
+        { "scale3x", make(Filter::Kind::Scale3x, false, false, 0) },
+        { "nearest+scanlines", make(Filter::Kind::Nearest, true, false, 0) },
+        { "nearest+grid", make(Filter::Kind::Nearest, false, true, 0) },
+        { "nearest+phosphor", make(Filter::Kind::Nearest, false, false, 192) },
+        { "scale3x+all", make(Filter::Kind::Scale3x, true, true, 192) },
+    };
+
+    // Noise with a sprite sized block moving over it, so that every frame differs
+    std::mt19937 rng(1);
+    std::vector<std::vector<uint8_t>> patterns(16, std::vector<uint8_t>(width * height / 8));
+    for (std::size_t p=0; p<patterns.size(); ++p)
+    {
+        for (auto & b : patterns[p])
+            b = (rng() % 4) ? 0 : rng();
+        for (std::size_t y=0; y<std::min<std::size_t>(15, height); ++y)
+            patterns[p][(y + p) % height * (width / 8) + p % (width / 8)] = 0xff;
+    }
+
+    std::cout << width << "x" << height << " -> " << width * scale << "x" << height * scale << ", " << frames << " frames\n";
+    for (auto & c : configs)
+    {
+        Filter::Upscaler up(width, height, c.opt);
+        std::vector<uint32_t> out(up.GetOutW() * up.GetOutH());
+
+        const auto start = std::chrono::steady_clock::now();
+        for (unsigned int f=0; f<frames; ++f)
+            up.Process(patterns[f % patterns.size()].data(), out.data(), up.GetOutW());
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+        uint64_t check = 0;
+        for (auto px : out)
+            check = check * 31 + px;
+
+        std::cout << "  " << std::left << std::setw(20) << c.name << std::right << std::fixed << std::setprecision(3)
+                  << elapsed.count() / frames << " ms/frame  (checksum " << std::hex << check << std::dec << ")\n";
+    }
+    return 0;
+}
@@ -0,0 +1,178 @@
+// chip8-fuzz: libFuzzer target for the interpreter.
+//
+// An input is a ROM image plus a key schedule:
+//   ROM size u16 (little endian) | ROM bytes | one key mask u16 per frame
+// The ROM runs headless for a bounded number of frames, in lockstep with the reference model
+// (see shadow.h), so besides the sanitizers the fuzzer also finds semantic divergences and
+// incremental hash bugs. After every frame the state must survive a serialize, deserialize and
+// load round trip, which also covers a call stack at its limit. The machine is constructed once; every input starts with a reset to
+// its state right after construction, which only restores the pages the last input wrote.
+//
+// Built with clang it links against libFuzzer, with ASan and UBSan. Otherwise a small driver runs the
+// inputs given on the command line, or random ones with --random N to measure throughput.
+
+#include <chrono>
+#include <algorithm>
+#include <random>
+#include <vector>
+#include <string>
+#include <cstdlib>
+#include <iostream>
+
+#include "src/machine.h"
+#include "src/headless.h"
+#include "src/shadow.h"
+#include "src/tools/corpus.h"
+
+namespace
+{
+
+typedef CHIP8Core<HeadlessBackend> Headless;
+
+const unsigned int MAX_FRAMES = 64;
+const unsigned int MIN_FRAMES = 8;
+const unsigned int IPF = 64;
+
+struct Harness
+{
+    Headless m;
+
+    Harness()
+    {
+        // Unknown opcodes are reported on the standard streams, far too often to be useful here
+        std::cout.rdbuf(nullptr);
+        std::cerr.rdbuf(nullptr);
+    }
+};
+
+Headless & Get()
+{
+    static Harness h;
+    return h.m;
+}
+
+// Saves, serializes and deserializes the state and loads it into a second machine, which must
+// end up with the same state and hash. False if anything came back different.
+bool RoundTrip(const Headless & m)
+{
+    static Headless copy;
+    static CHIP8State saved, loaded;
+    static std::vector<uint8_t> image;
+
+    m.SaveState(saved);
+    image.resize(saved.SerializedSize());
+    saved.Serialize(image.data());
+    if (!loaded.Deserialize(image.data(), image.size()) || !(loaded == saved))
+        return false;
+
+    copy.LoadState(loaded);
+    copy.SaveState(loaded);
+    return loaded == saved && copy.StateHash() == saved.Hash();
+}
+
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t * data, std::size_t size)
+{
+    auto & m = Get();
+
+    if (size < 2)
+        return 0;
+
+    // GetRamSize() is what fits above MEMORY_USABLE, so LoadROM never rejects the ROM
+    const std::size_t rom_size = std::min<std::size_t>(data[0] | data[1] << 8, std::min(size - 2, m.GetRamSize()));
+    const uint8_t * rom = data + 2;
+    const uint8_t * keys = rom + rom_size;
+    const std::size_t schedule = (size - 2 - rom_size) / 2;
+
+    m.ResetToBaseline();
+    m.LoadROM(rom, rom_size);
+
+    Shadow<Headless> shadow(m, 64, 16);
+    const auto frames = std::clamp<std::size_t>(schedule, MIN_FRAMES, MAX_FRAMES);
+
+    auto status = Shadow<Headless>::Status::Running;
+    for (std::size_t f=0; f<frames && status == Shadow<Headless>::Status::Running; ++f)
+    {
+        shadow.SetKeys(f < schedule ? uint16_t(keys[2 * f] | keys[2 * f + 1] << 8) : 0);
+        status = shadow.RunFrame(IPF);
+
+        if (!RoundTrip(m))
+        {
+            std::clog << "State does not survive a save and load\n";
+            std::abort();
+        }
+    }
+
+    if (status == Shadow<Headless>::Status::Diverged)
+    {
+        shadow.Dump(std::clog);
+        std::abort();
+    }
+
+    return 0;
+}
+
+#ifndef CHIP8_LIBFUZZER
+
+int main(int argc, char* argv[])
+{
+    uint64_t random = 0;
+    std::vector<std::filesystem::path> corpus;
+
+    for (auto i=1; i<argc; ++i)
+    {
+        const std::string arg{argv[i]};
+        if (arg == "--random" && i + 1 < argc)
+            random = std::stoull(argv[++i]);
+        else
+            AddToCorpus(corpus, arg);
+    }
+
+    if (corpus.empty() && !random) {
+        std::clog << "Please specify inputs to run, or a number of random inputs." << std::endl;
+        std::clog << "EX:" << std::endl;
+        std::clog << argv[0] << " [--random N] [INPUT|DIR]..." << std::endl;
+        std::clog << std::endl;
+        return 1;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    for (auto & path : corpus)
+    {
+        auto input = ReadROM(path);
+        LLVMFuzzerTestOneInput(input.data(), input.size());
+    }
+
+    // Random ROMs are mostly unknown opcodes; bias them towards real instructions
+    std::mt19937_64 gen(1);
+    std::vector<uint8_t> input;
+    for (uint64_t r=0; r<random; ++r)
+    {
+        const std::size_t rom_size = 2 * (1 + gen() % 128);
+        input.assign({ uint8_t(rom_size), uint8_t(rom_size >> 8) });
+        for (std::size_t i=0; i<rom_size; i += 2)
+        {
+            uint16_t op = gen();
+            if (op >> 12 == 0x0)
+                op = (gen() % 2) ? 0x00e0 : 0x00ee;
+            input.push_back(op >> 8);
+            input.push_back(op);
+        }
+        for (auto f = gen() % MAX_FRAMES; f; --f)
+        {
+            const uint16_t k = (gen() % 4) ? 0 : 1 << (gen() % 16);
+            input.push_back(k);
+            input.push_back(k >> 8);
+        }
+        LLVMFuzzerTestOneInput(input.data(), input.size());
+    }
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    const auto execs = corpus.size() + random;
+    std::clog << execs << " inputs in " << elapsed.count() << "s (" << uint64_t(execs / elapsed.count()) << " execs/s)" << std::endl;
+    return 0;
+}
+
+#endif
@@ -0,0 +1,158 @@
+// chip8-latency: input to photon latency of a ROM in frames, without run-ahead and with it (see
+// src/runahead.h). Keys are pressed on a schedule. At every press the machine is forked into a
+// copy that never sees it, and the latency is the number of frames from the one the press was
+// fed in until the two present different pictures. Presses that show nothing within the window
+// are counted apart.
+
+#include <chrono>
+#include <memory>
+#include <vector>
+#include <string>
+#include <iomanip>
+#include <iostream>
+#include <algorithm>
+
+#include "src/libchip8.h"
+#include "src/runahead.h"
+#include "src/tools/corpus.h"
+
+namespace
+{
+
+typedef std::unique_ptr<chip8_t, decltype(&chip8_destroy)> MachinePtr;
+
+struct Options
+{
+    std::string rom;
+    unsigned int ipf = 12;
+    unsigned int run_ahead = 2;
+    unsigned int presses = 64;
+    unsigned int interval = 30;                 // Idle frames before every press
+    unsigned int hold = 6;                      // Frames a key stays down
+    unsigned int window = 60;                   // Frames to wait for the press to show
+};
+
+struct Result
+{
+    unsigned int presses = 0;
+    unsigned int shown = 0;                     // Presses that changed the picture in the window
+    uint64_t frames = 0;                        // Latency, summed over the shown presses
+    unsigned int max = 0;
+    uint64_t stepped = 0;                       // Real frames timed
+    std::chrono::nanoseconds time{0};
+};
+
+MachinePtr Create(const std::vector<uint8_t> & rom)
+{
+    MachinePtr m(chip8_create(), chip8_destroy);
+    if (!m)
+        return m;
+    chip8_set_seed(m.get(), 12345);
+    if (chip8_load_rom_from_memory(m.get(), rom.data(), rom.size()))
+        m.reset();
+    return m;
+}
+
+Result Measure(const std::vector<uint8_t> & rom, const Options & opt, unsigned int ahead)
+{
+    Result r;
+    auto m = Create(rom);
+    RunAhead run(m.get(), ahead);
+    chip8_registers_t regs;
+    std::size_t size = 0;
+    std::vector<uint8_t> state;
+
+    for (unsigned int p=0; p<opt.presses && chip8_is_running(m.get()); ++p)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        for (unsigned int f=0; f<opt.interval; ++f)
+            run.Step(0, opt.ipf, regs);
+        r.time += std::chrono::steady_clock::now() - start;
+        r.stepped += opt.interval;
+
+        // The fork never sees the press
+        state.resize(chip8_save_state(m.get(), nullptr, 0));
+        chip8_save_state(m.get(), state.data(), state.size());
+        auto fork = Create(rom);
+        chip8_load_state(fork.get(), state.data(), state.size());
+        RunAhead fork_run(fork.get(), ahead);
+
+        const uint16_t key = 1 << (p % 16);
+        int latency = -1;
+        for (unsigned int f=0; f<opt.window; ++f)
+        {
+            const uint8_t * pressed = run.Step(f < opt.hold ? key : 0, opt.ipf, regs, &size);
+            if (latency >= 0)
+                continue;
+            const uint8_t * idle = fork_run.Step(0, opt.ipf, regs);
+            if (!std::equal(pressed, pressed + size, idle))
+                latency = f;
+        }
+
+        ++r.presses;
+        if (latency >= 0)
+        {
+            ++r.shown;
+            r.frames += latency;
+            r.max = std::max<unsigned int>(r.max, latency);
+        }
+    }
+    return r;
+}
+
+void Report(unsigned int ahead, const Result & r)
+{
+    std::cout << "run-ahead " << ahead << ": " << r.shown << " of " << r.presses << " presses shown, latency";
+    if (r.shown)
+        std::cout << " avg=" << std::fixed << std::setprecision(2) << double(r.frames) / r.shown << " max=" << r.max << " frames";
+    else
+        std::cout << " n/a";
+    std::cout << ", " << std::fixed << std::setprecision(1)
+              << std::chrono::duration<double, std::micro>(r.time).count() / std::max<uint64_t>(r.stepped, 1) << "us per frame\n";
+    std::cout << std::defaultfloat;
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+    Options opt;
+    for (auto i=1; i<argc; ++i)
+    {
+        const std::string arg{argv[i]};
+        const bool has_value = i + 1 < argc;
+        if (arg == "--ipf" && has_value)
+            opt.ipf = std::max(1ul, std::stoul(argv[++i]));
+        else if (arg == "--run-ahead" && has_value)
+            opt.run_ahead = std::min(std::stoul(argv[++i]), 8ul);
+        else if (arg == "--presses" && has_value)
+            opt.presses = std::stoul(argv[++i]);
+        else if (arg == "--interval" && has_value)
+            opt.interval = std::stoul(argv[++i]);
+        else if (arg == "--hold" && has_value)
+            opt.hold = std::stoul(argv[++i]);
+        else if (arg == "--window" && has_value)
+            opt.window = std::max(1ul, std::stoul(argv[++i]));
+        else
+            opt.rom = arg;
+    }
+
+    if (opt.rom.empty()) {
+        std::cerr << "Please specify a ROM to measure." << std::endl;
+        std::cerr << "EX:" << std::endl;
+        std::cerr << argv[0] << " [--ipf N] [--run-ahead N] [--presses N] [--interval FRAMES] [--hold FRAMES] [--window FRAMES] [ROMFILE.ch8]" << std::endl;
+        std::cerr << std::endl;
+        return 1;
+    }
+
+    const auto rom = ReadROM(opt.rom);
+    if (rom.empty() || !Create(rom)) {
+        std::cerr << "Error loading ROM " << opt.rom << "\n";
+        return 1;
+    }
+
+    Report(0, Measure(rom, opt, 0));
+    if (opt.run_ahead)
+        Report(opt.run_ahead, Measure(rom, opt, opt.run_ahead));
+    return 0;
+}
@@ -0,0 +1,103 @@
+// chip8-peek: attaches to the shared memory exported by `chip8 --share /NAME`, optionally
+// presses keys, and prints the newest frame. With --follow it keeps reading every frame for a
+// while and reports how many it saw and missed.
+
+#include <chrono>
+#include <thread>
+#include <string>
+#include <iomanip>
+#include <iostream>
+
+#include "src/shm.h"
+
+namespace
+{
+
+void Print(const SharedMemory::Frame & f)
+{
+    std::cout << "frame " << std::dec << f.frame << std::hex << std::setfill('0')
+              << " PC=" << std::setw(4) << f.PC << " I=" << std::setw(4) << f.I
+              << " delay=" << std::setw(2) << +f.delay << " sound=" << std::setw(2) << +f.sound
+              << " keys=" << std::setw(4) << f.keys << "\n";
+    for (std::size_t x=0; x<f.V.size(); ++x)
+        std::cout << "V" << x << "=" << std::setw(2) << +f.V[x] << (x % 8 == 7 ? "\n" : " ");
+    std::cout << std::dec << std::setfill(' ');
+
+    for (auto y=0; y<32; ++y)
+    {
+        for (auto x=0; x<64; ++x)
+            std::cout << (((f.video[(y * 64 + x) / 8] >> (7 - x % 8)) & 0x1) ? '#' : '.');
+        std::cout << "\n";
+    }
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+    std::string name;
+    int keys = -1;
+    double follow = 0;
+
+    for (auto i=1; i<argc; ++i)
+    {
+        const std::string arg{argv[i]};
+        if (arg == "--keys" && i + 1 < argc)
+            keys = std::stoul(argv[++i], nullptr, 16) & 0xffff;
+        else if (arg == "--follow" && i + 1 < argc)
+            follow = std::stod(argv[++i]);
+        else
+            name = arg;
+    }
+
+    if (name.empty()) {
+        std::cerr << "Please specify the shared memory name given to chip8 --share." << std::endl;
+        std::cerr << "EX:" << std::endl;
+        std::cerr << argv[0] << " [--keys HEXMASK] [--follow SECONDS] [/NAME]" << std::endl;
+        std::cerr << std::endl;
+        return 1;
+    }
+
+    SharedMemory::Viewer view;
+    if (!view.Attach(name)) {
+        std::cerr << "Error attaching to shared memory " << name << "\n";
+        return 1;
+    }
+
+    if (keys >= 0 && !view.PushKeys(keys)) {
+        std::cerr << "Key ring is full\n";
+        return 1;
+    }
+
+    SharedMemory::Frame f;
+    if (follow > 0)
+    {
+        uint64_t next = view.Latest() + 1;
+        uint64_t seen = 0;
+        uint64_t missed = 0;
+
+        const auto end = std::chrono::steady_clock::now() + std::chrono::duration<double>(follow);
+        while (std::chrono::steady_clock::now() < end)
+        {
+            const auto latest = view.Latest();
+            for (; next <= latest; ++next)
+            {
+                if (view.Read(next, f))
+                    ++seen;
+                else
+                    ++missed;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+
+        std::cout << "frames seen=" << seen << " missed=" << missed << "\n";
+    }
+
+    if (!view.ReadLatest(f)) {
+        std::cerr << "Nothing published yet\n";
+        return 1;
+    }
+
+    Print(f);
+    return 0;
+}
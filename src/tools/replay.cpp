@@ -0,0 +1,98 @@
+// chip8-replay: runs an input movie recorded with `chip8 --movie` headless and as fast as
+// possible, checking the framebuffer of every frame against the hash stored in the movie.
+
+#include <chrono>
+#include <memory>
+#include <vector>
+#include <string>
+#include <iostream>
+
+#include "src/machine.h"
+#include "src/headless.h"
+#include "src/movie.h"
+#include "src/video.h"
+#include "src/tools/corpus.h"
+
+namespace
+{
+
+typedef CHIP8Core<HeadlessBackend> Headless;
+
+}
+
+int main(int argc, char* argv[])
+{
+    std::string record;
+    std::vector<std::string> files;
+
+    for (auto i=1; i<argc; ++i)
+    {
+        const std::string arg{argv[i]};
+        if (arg == "--record" && i + 1 < argc)
+            record = argv[++i];
+        else
+            files.push_back(arg);
+    }
+
+    if (files.size() != 2) {
+        std::cerr << "Please specify a movie and the ROM it was recorded on." << std::endl;
+        std::cerr << "EX:" << std::endl;
+        std::cerr << argv[0] << " [--record CAPTURE.c8v] [MOVIE.c8m] [ROMFILE.ch8]" << std::endl;
+        std::cerr << std::endl;
+        return 1;
+    }
+
+    Movie movie;
+    if (!movie.Load(files[0])) {
+        std::cerr << "Error loading movie " << files[0] << "\n";
+        return 1;
+    }
+
+    auto rom = ReadROM(files[1]);
+    if (Movie::Hash(rom.data(), rom.size()) != movie.rom_hash) {
+        std::cerr << "ROM " << files[1] << " is not the one " << files[0] << " was recorded on\n";
+        return 1;
+    }
+
+    auto m = std::make_unique<Headless>();
+    m->SetSeed(movie.seed);
+    m->Reset();
+    if (!m->LoadROM(rom.data(), rom.size())) {
+        std::cerr << "Error loading ROM " << files[1] << "\n";
+        return 1;
+    }
+    if (!movie.ipf)
+        m->SetTiming(Headless::Timing::VIP);
+
+    Video::Recorder recorder(64, 32);
+    if (!record.empty() && !recorder.Open(record)) {
+        std::cerr << "Error opening capture " << record << "\n";
+        return 1;
+    }
+
+    const uint8_t * video = m->GetRam().begin() + Headless::MEMORY_VIDEO;
+    const std::size_t video_size = m->GetRam().end() - video;
+
+    auto start = std::chrono::steady_clock::now();
+    std::size_t f = 0;
+    for (; f < movie.frames.size(); ++f)
+    {
+        m->GetInput().SetKeys(movie.frames[f].keys);
+        m->RunFrame(movie.ipf);
+        recorder.Capture(video);
+
+        if (Movie::Hash(video, video_size) != movie.frames[f].video_hash)
+            break;
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    recorder.Close();
+
+    std::cout << f << " frames (" << f / 60.0 << "s of play) replayed in " << elapsed.count() << "s\n";
+    if (f != movie.frames.size()) {
+        std::cerr << "Framebuffer diverged at frame " << f << "\n";
+        return 1;
+    }
+
+    std::cout << "Bit identical\n";
+    return 0;
+}
@@ -0,0 +1,196 @@
+// chip8-scan: static analysis of a ROM library. Every ROM is disassembled from its entry point
+// (see src/romindex.h) on a pool of threads, and the results are merged into the index the
+// front end reads when it loads a ROM.
+
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <iomanip>
+#include <iostream>
+
+#include "src/romindex.h"
+#include "src/tools/corpus.h"
+
+namespace
+{
+
+struct Options
+{
+    unsigned int threads = std::max(1u, std::thread::hardware_concurrency());
+    std::string index = "chip8.idx";
+    bool disasm = false;                        // Print the reachable code of every ROM
+    bool verbose = false;                       // Print every entry
+};
+
+std::string Hex(unsigned int v, int w)
+{
+    std::stringstream ss;
+    ss << std::hex << std::setw(w) << std::setfill('0') << v;
+    return ss.str();
+}
+
+std::string Mnemonic(uint16_t op)
+{
+    const std::string X = "V" + Hex((op >> 8) & 0xf, 1), Y = "V" + Hex((op >> 4) & 0xf, 1);
+    const auto N = op & 0xf, NN = op & 0xff, NNN = op & 0xfff;
+    switch (op >> 12)
+    {
+    case 0x0:
+        if (op == 0x00e0) return "CLS";
+        if (op == 0x00ee) return "RET";
+        if ((op & 0xfff0) == 0x00c0) return "SCD " + Hex(N, 1);
+        if ((op & 0xfff0) == 0x00d0) return "SCU " + Hex(N, 1);
+        if (op == 0x00fb) return "SCR";
+        if (op == 0x00fc) return "SCL";
+        if (op == 0x00fd) return "EXIT";
+        if (op == 0x00fe) return "LOW";
+        if (op == 0x00ff) return "HIGH";
+        return "SYS " + Hex(NNN, 3);
+    case 0x1: return "JP " + Hex(NNN, 3);
+    case 0x2: return "CALL " + Hex(NNN, 3);
+    case 0x3: return "SE " + X + ", " + Hex(NN, 2);
+    case 0x4: return "SNE " + X + ", " + Hex(NN, 2);
+    case 0x5:
+        if (N == 0) return "SE " + X + ", " + Y;
+        if (N == 2) return "SAVE " + X + "-" + Y;
+        if (N == 3) return "LOAD " + X + "-" + Y;
+        break;
+    case 0x6: return "LD " + X + ", " + Hex(NN, 2);
+    case 0x7: return "ADD " + X + ", " + Hex(NN, 2);
+    case 0x8:
+    {
+        static const char * names[] = { "LD", "OR", "AND", "XOR", "ADD", "SUB", "SHR", "SUBN" };
+        if (N <= 0x7) return std::string(names[N]) + " " + X + ", " + Y;
+        if (N == 0xe) return "SHL " + X + ", " + Y;
+        break;
+    }
+    case 0x9: if (N == 0) return "SNE " + X + ", " + Y; break;
+    case 0xa: return "LD I, " + Hex(NNN, 3);
+    case 0xb: return "JP V0, " + Hex(NNN, 3);
+    case 0xc: return "RND " + X + ", " + Hex(NN, 2);
+    case 0xd: return "DRW " + X + ", " + Y + ", " + Hex(N, 1);
+    case 0xe:
+        if (NN == 0x9e) return "SKP " + X;
+        if (NN == 0xa1) return "SKNP " + X;
+        break;
+    case 0xf:
+        switch (NN)
+        {
+        case 0x00: return "LD I, long";
+        case 0x01: return "PLANE " + Hex((op >> 8) & 0xf, 1);
+        case 0x02: return "AUDIO";
+        case 0x07: return "LD " + X + ", DT";
+        case 0x0a: return "LD " + X + ", K";
+        case 0x15: return "LD DT, " + X;
+        case 0x18: return "LD ST, " + X;
+        case 0x1e: return "ADD I, " + X;
+        case 0x29: return "LD F, " + X;
+        case 0x30: return "LD HF, " + X;
+        case 0x33: return "LD B, " + X;
+        case 0x3a: return "PITCH " + X;
+        case 0x55: return "LD [I], " + X;
+        case 0x65: return "LD " + X + ", [I]";
+        case 0x75: return "LD R, " + X;
+        case 0x85: return "LD " + X + ", R";
+        }
+        break;
+    }
+    return "???";
+}
+
+RomIndex::Entry Scan(const std::filesystem::path & path, bool disasm, std::string & listing)
+{
+    const auto rom = ReadROM(path);
+    RomIndex::Analyzer analyzer(rom);
+
+    std::stringstream os;
+    auto entry = disasm ? analyzer.Run([&os](unsigned int addr, uint16_t op) { os << Hex(addr, 3) << ": " << Hex(op, 4) << "  " << Mnemonic(op) << "\n"; })
+                        : analyzer.Run();
+    entry.file = path.string();
+    listing = os.str();
+    return entry;
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+    Options opt;
+    std::vector<std::filesystem::path> corpus;
+
+    for (auto i=1; i<argc; ++i)
+    {
+        const std::string arg{argv[i]};
+        const bool has_value = i + 1 < argc;
+        if (arg == "--threads" && has_value)
+            opt.threads = std::max(1ul, std::stoul(argv[++i]));
+        else if (arg == "--index" && has_value)
+            opt.index = argv[++i];
+        else if (arg == "--disasm")
+            opt.disasm = true;
+        else if (arg == "--verbose")
+            opt.verbose = true;
+        else
+            AddToCorpus(corpus, arg);
+    }
+
+    if (corpus.empty()) {
+        std::cerr << "Please specify ROMs or directories to scan." << std::endl;
+        std::cerr << "EX:" << std::endl;
+        std::cerr << argv[0] << " [--threads N] [--index FILE] [--disasm] [--verbose] [ROMFILE.ch8|DIR]..." << std::endl;
+        std::cerr << std::endl;
+        return 1;
+    }
+
+    std::vector<RomIndex::Entry> entries(corpus.size());
+    std::vector<std::string> listings(corpus.size());
+    std::atomic<std::size_t> next{0};
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for (unsigned int t=0; t<std::min<std::size_t>(opt.threads, corpus.size()); ++t)
+        workers.emplace_back([&]()
+        {
+            for (auto i=next++; i<corpus.size(); i=next++)
+                entries[i] = Scan(corpus[i], opt.disasm, listings[i]);
+        });
+    for (auto & w : workers)
+        w.join();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    auto index = RomIndex::Load(opt.index);
+    std::map<std::string, unsigned int> platforms;
+    unsigned int skipped = 0;
+    for (std::size_t i=0; i<corpus.size(); ++i)
+    {
+        const auto & e = entries[i];
+        if (opt.disasm)
+            std::cout << "; " << e << "\n" << listings[i] << "\n";
+        else if (opt.verbose)
+            std::cout << e << "\n";
+
+        // Nothing executable at the entry point: not a ROM
+        if (!e.reachable || e.unknown == e.reachable)
+        {
+            ++skipped;
+            continue;
+        }
+        index[e.key] = e;
+        ++platforms[e.Platform()];
+    }
+
+    if (!RomIndex::Save(opt.index, index)) {
+        std::cerr << "Error writing index " << opt.index << "\n";
+        return 1;
+    }
+
+    std::cout << "Scanned " << corpus.size() << " files in " << std::fixed << std::setprecision(3) << elapsed.count() << "s:";
+    for (auto & [platform, count] : platforms)
+        std::cout << " " << platform << "=" << count;
+    std::cout << " not ROMs=" << skipped << ", " << index.size() << " entries in " << opt.index << "\n";
+    return 0;
+}
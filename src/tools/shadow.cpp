@@ -0,0 +1,170 @@
+// chip8-shadow: soak test running every ROM of a corpus on the production machine and on the
+// reference model in lockstep, with randomized input, spread over all host cores.
+
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+#include <string>
+#include <iostream>
+#include <functional>
+
+#include "src/machine.h"
+#include "src/headless.h"
+#include "src/shadow.h"
+#include "src/tools/corpus.h"
+
+namespace
+{
+
+typedef CHIP8Core<HeadlessBackend> Headless;
+
+struct Options
+{
+    unsigned int frames = 600;
+    unsigned int ipf = 1000;
+    unsigned int runs = 4;
+    uint64_t every = 1000;
+    std::size_t history = 32;
+    uint64_t seed = 1;
+    unsigned int threads = std::max(1u, std::thread::hardware_concurrency());
+};
+
+struct Totals
+{
+    std::atomic<uint64_t> instructions{0};
+    std::atomic<uint64_t> checks{0};
+    std::atomic<uint64_t> runs{0};
+    std::atomic<uint64_t> diverged{0};
+    std::atomic<uint64_t> unsupported{0};
+};
+
+// Random key presses: a key (or none) is held for a random number of frames
+class KeySchedule
+{
+    std::mt19937_64 gen;
+    uint16_t mask;
+    unsigned int hold;
+
+public:
+    KeySchedule(uint64_t seed) : gen{seed}, mask{0}, hold{0} { };
+
+    uint16_t Next()
+    {
+        if (hold-- == 0)
+        {
+            const auto k = gen() % 20;
+            mask = k < 16 ? (1 << k) : 0;
+            hold = gen() % 30;
+        }
+        return mask;
+    }
+};
+
+void RunJob(const std::filesystem::path & path, const std::vector<uint8_t> & rom, unsigned int run, const Options & opt, Totals & totals, std::mutex & out)
+{
+    auto m = std::make_unique<Headless>();
+    m->SetFusion(run % 2 == 0);                 // Both decode paths
+    m->LoadROM(rom.data(), rom.size());
+
+    Shadow<Headless> shadow(*m, opt.every, opt.history);
+    KeySchedule keys(opt.seed ^ std::hash<std::string>{}(path.string()) ^ (uint64_t(run) << 32));
+
+    auto status = Shadow<Headless>::Status::Running;
+    for (unsigned int f=0; f<opt.frames && status == Shadow<Headless>::Status::Running; ++f)
+    {
+        shadow.SetKeys(keys.Next());
+        status = shadow.RunFrame(opt.ipf);
+    }
+
+    totals.instructions += m->GetRetired();
+    totals.checks += shadow.GetChecks();
+    ++totals.runs;
+
+    if (status == Shadow<Headless>::Status::Unsupported)
+        ++totals.unsupported;
+
+    if (status == Shadow<Headless>::Status::Diverged)
+    {
+        ++totals.diverged;
+        std::lock_guard<std::mutex> lock(out);
+        std::cout << "DIVERGED: " << path.string() << " run " << run << " (fusion " << (run % 2 == 0 ? "on" : "off") << ")\n";
+        shadow.Dump(std::cout);
+    }
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+    Options opt;
+    std::vector<std::filesystem::path> corpus;
+
+    for (auto i=1; i<argc; ++i)
+    {
+        const std::string arg{argv[i]};
+        const bool has_value = i + 1 < argc;
+        if (arg == "--frames" && has_value)
+            opt.frames = std::stoul(argv[++i]);
+        else if (arg == "--ipf" && has_value)
+            opt.ipf = std::stoul(argv[++i]);
+        else if (arg == "--runs" && has_value)
+            opt.runs = std::stoul(argv[++i]);
+        else if (arg == "--every" && has_value)
+            opt.every = std::stoull(argv[++i]);
+        else if (arg == "--history" && has_value)
+            opt.history = std::stoul(argv[++i]);
+        else if (arg == "--seed" && has_value)
+            opt.seed = std::stoull(argv[++i]);
+        else if (arg == "--threads" && has_value)
+            opt.threads = std::max(1ul, std::stoul(argv[++i]));
+        else
+            AddToCorpus(corpus, arg);
+    }
+
+    if (corpus.empty()) {
+        std::cerr << "Please specify ROMs or directories to check." << std::endl;
+        std::cerr << "EX:" << std::endl;
+        std::cerr << argv[0] << " [--frames N] [--ipf N] [--runs N] [--every N] [--history K] [--seed S] [--threads N] [ROMFILE.ch8|DIR]..." << std::endl;
+        std::cerr << std::endl;
+        return 1;
+    }
+
+    std::vector<std::vector<uint8_t>> roms;
+    for (auto & path : corpus)
+        roms.push_back(ReadROM(path));
+
+    Totals totals;
+    std::mutex out;
+    std::atomic<std::size_t> next{0};
+    const std::size_t jobs = corpus.size() * opt.runs;
+
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<std::thread> workers;
+    for (unsigned int t=0; t<opt.threads; ++t)
+        workers.emplace_back([&]()
+        {
+            for (auto job = next++; job < jobs; job = next++)
+            {
+                const auto r = job / opt.runs;
+                if (roms[r].empty() || roms[r].size() > Headless::MemorySpecs::Size - Headless::MEMORY_USABLE)
+                    continue;
+                RunJob(corpus[r], roms[r], job % opt.runs, opt, totals, out);
+            }
+        });
+    for (auto & w : workers)
+        w.join();
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    std::cout << "runs=" << totals.runs << " instructions=" << totals.instructions << " checks=" << totals.checks
+              << " diverged=" << totals.diverged << " unsupported=" << totals.unsupported
+              << " threads=" << opt.threads << " time=" << elapsed.count() << "s"
+              << " IPS=" << uint64_t(totals.instructions / elapsed.count()) << "\n";
+
+    return totals.diverged ? 1 : 0;
+}
@@ -0,0 +1,124 @@
+// chip8-video: converts a framebuffer capture (see src/video.h) to uncompressed video.
+// An output ending in .y4m is written as a single YUV4MPEG2 stream; anything else is used as
+// the prefix of a numbered PPM sequence (PREFIX_000000.ppm, ...).
+
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+
+#include "src/video.h"
+
+namespace
+{
+
+// Expands the current frame to scale x scale blocks of luma, 0 or 255
+void Expand(const Video::Reader & r, unsigned int scale, std::vector<uint8_t> & out)
+{
+    const std::size_t W = r.GetW() * scale;
+    out.resize(W * r.GetH() * scale);
+    for (uint16_t y=0; y<r.GetH(); ++y)
+    {
+        auto row = out.begin() + y * scale * W;
+        for (uint16_t x=0; x<r.GetW(); ++x)
+            std::fill_n(row + x * scale, scale, r.Pixel(x, y) ? 0xff : 0x00);
+        for (unsigned int s=1; s<scale; ++s)
+            std::copy(row, row + W, row + s * W);
+    }
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+    unsigned int scale = 10;
+    std::vector<std::string> files;
+
+    for (auto i=1; i<argc; ++i)
+    {
+        const std::string arg{argv[i]};
+        if (arg == "--scale" && i + 1 < argc)
+            scale = std::max(1ul, std::stoul(argv[++i]));
+        else
+            files.push_back(arg);
+    }
+
+    if (files.size() != 2) {
+        std::cerr << "Please specify a capture and an output." << std::endl;
+        std::cerr << "EX:" << std::endl;
+        std::cerr << argv[0] << " [--scale N] [CAPTURE.c8v] [OUT.y4m | OUT_PREFIX]" << std::endl;
+        std::cerr << std::endl;
+        return 1;
+    }
+
+    Video::Reader r;
+    if (!r.Open(files[0])) {
+        std::cerr << "Error loading capture " << files[0] << "\n";
+        return 1;
+    }
+
+    const auto & out = files[1];
+    const bool y4m = out.size() > 4 && out.substr(out.size() - 4) == ".y4m";
+    const unsigned int W = r.GetW() * scale;
+    const unsigned int H = r.GetH() * scale;
+
+    std::ofstream os;
+    if (y4m)
+    {
+        os.open(out, std::ios::out | std::ios::binary | std::ios::trunc);
+        if (!os.is_open()) {
+            std::cerr << "Error writing " << out << "\n";
+            return 1;
+        }
+        os << "YUV4MPEG2 W" << W << " H" << H << " F" << +r.GetFPS() << ":1 Ip A1:1 C444\n";
+    }
+
+    std::vector<uint8_t> luma;
+    std::vector<uint8_t> chroma(std::size_t(W) * H, 0x80);
+    std::vector<uint8_t> rgb;
+    uint64_t frames = 0;
+
+    while (r.Next())
+    {
+        Expand(r, scale, luma);
+
+        if (y4m)
+        {
+            // Studio range luma, neutral chroma
+            for (auto & l : luma)
+                l = l ? 235 : 16;
+            os << "FRAME\n";
+            os.write(reinterpret_cast<const char*>(luma.data()), luma.size());
+            os.write(reinterpret_cast<const char*>(chroma.data()), chroma.size());
+            os.write(reinterpret_cast<const char*>(chroma.data()), chroma.size());
+        }
+        else
+        {
+            char name[32];
+            std::snprintf(name, sizeof(name), "_%06llu.ppm", static_cast<unsigned long long>(frames));
+
+            rgb.resize(luma.size() * 3);
+            for (std::size_t p=0; p<luma.size(); ++p)
+                std::fill_n(rgb.begin() + 3 * p, 3, luma[p]);
+
+            std::ofstream ppm(out + name, std::ios::out | std::ios::binary | std::ios::trunc);
+            if (!ppm.is_open()) {
+                std::cerr << "Error writing " << out + name << "\n";
+                return 1;
+            }
+            ppm << "P6\n" << W << " " << H << "\n255\n";
+            ppm.write(reinterpret_cast<const char*>(rgb.data()), rgb.size());
+        }
+
+        ++frames;
+    }
+
+    if (r.IsError()) {
+        std::cerr << "Capture " << files[0] << " is truncated or corrupt after " << frames << " frames\n";
+        return 1;
+    }
+
+    std::cout << frames << " frames of " << W << "x" << H << " written to " << out << (y4m ? "" : "_*.ppm") << "\n";
+    return 0;
+}
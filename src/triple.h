@@ -0,0 +1,50 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+// Lock-free triple buffer between one writer and one reader. The writer fills Back() and
+// publishes it; the reader picks up the latest published slot with Update() and reads Front().
+// Neither side ever waits: a frame published before the reader got to the previous one replaces
+// it, and is counted as dropped.
+template <class T>
+class TripleBuffer
+{
+protected:
+    static constexpr uint8_t INDEX = 0x3;
+    static constexpr uint8_t FRESH = 0x4;       // Middle slot published and not read yet
+
+    std::array<T, 3> slots;
+    std::atomic<uint8_t> middle;                // Slot index in between, plus FRESH
+    uint8_t back;                               // Writer only
+    uint8_t front;                              // Reader only
+    std::atomic<uint64_t> dropped;
+
+public:
+    TripleBuffer() : slots{}, middle{1}, back{0}, front{2}, dropped{0} { };
+
+    T & Back() { return slots[back]; };
+
+    void Publish()
+    {
+        const auto old = middle.exchange(back | FRESH, std::memory_order_acq_rel);
+        back = old & INDEX;
+        if (old & FRESH)
+            dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Returns false when nothing was published since the last call; Front() stays the same
+    bool Update()
+    {
+        if (!(middle.load(std::memory_order_relaxed) & FRESH))
+            return false;
+
+        front = middle.exchange(front, std::memory_order_acq_rel) & INDEX;
+        return true;
+    }
+
+    const T & Front() const { return slots[front]; };
+
+    uint64_t GetDropped() const { return dropped.load(std::memory_order_relaxed); };
+};
@@ -0,0 +1,303 @@
+#pragma once
+
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <fstream>
+#include <algorithm>
+#include <condition_variable>
+
+// Capture of the 1-bit framebuffer, one frame per 60hz tick.
+//
+// File layout (integers little endian):
+//   "C8VR" | version u8 | width u16 | height u16 | fps u8
+//   per frame: payload size (varint) | payload
+//
+// A payload is the XOR of the frame against the previous one (all zeros before the first),
+// run-length encoded as (skip varint, count varint, count literal bytes) groups until the whole
+// frame is covered. An unchanged frame is a single group.
+namespace Video
+{
+
+const char MAGIC[4] = { 'C', '8', 'V', 'R' };
+const uint8_t VERSION = 1;
+
+inline void PutVarint(std::vector<uint8_t> & out, uint32_t v)
+{
+    while (v >= 0x80)
+    {
+        out.push_back(uint8_t(v) | 0x80);
+        v >>= 7;
+    }
+    out.push_back(uint8_t(v));
+}
+
+inline bool GetVarint(const uint8_t *& p, const uint8_t * end, uint32_t & v)
+{
+    v = 0;
+    for (int shift=0; p != end && shift < 32; shift += 7)
+    {
+        const uint8_t b = *p++;
+        v |= uint32_t(b & 0x7f) << shift;
+        if (!(b & 0x80))
+            return true;
+    }
+    return false;
+}
+
+// Largest payload EncodeDelta() writes for a frame of `bytes`: one group per two bytes at worst
+inline std::size_t MaxPayload(std::size_t bytes) { return bytes * 2 + 16; };
+
+// Appends the encoded delta between prev and frame, then makes prev a copy of frame
+inline void EncodeDelta(std::vector<uint8_t> & prev, const uint8_t * frame, std::vector<uint8_t> & out)
+{
+    const std::size_t n = prev.size();
+    std::size_t i = 0;
+    do
+    {
+        const auto skip_start = i;
+        while (i < n && prev[i] == frame[i])
+            ++i;
+        const auto literal_start = i;
+        while (i < n && prev[i] != frame[i])
+            ++i;
+
+        PutVarint(out, literal_start - skip_start);
+        PutVarint(out, i - literal_start);
+        for (auto j = literal_start; j < i; ++j)
+        {
+            out.push_back(prev[j] ^ frame[j]);
+            prev[j] = frame[j];
+        }
+    } while (i < n);
+}
+
+// Applies an encoded delta in place. False on a malformed payload.
+inline bool DecodeDelta(const uint8_t * p, const uint8_t * end, std::vector<uint8_t> & frame)
+{
+    std::size_t i = 0;
+    while (p != end)
+    {
+        uint32_t skip, count;
+        if (!GetVarint(p, end, skip) || !GetVarint(p, end, count))
+            return false;
+        if (i + skip + count > frame.size() || count > std::size_t(end - p))
+            return false;
+
+        i += skip;
+        for (uint32_t j=0; j<count; ++j)
+            frame[i++] ^= *p++;
+    }
+    return true;
+}
+
+// Encodes on the caller thread (a few hundred bytes at most) and hands the payload to a writer
+// thread through a fixed ring of buffers, so steady state recording does not allocate nor touch
+// the disk. When the ring is full the caller waits for the writer.
+class Recorder
+{
+protected:
+    struct Slot
+    {
+        std::vector<uint8_t> data;
+    };
+
+    std::ofstream os;
+    uint16_t width;
+    uint16_t height;
+    std::vector<uint8_t> prev;                  // Last captured frame
+
+    std::vector<Slot> ring;
+    std::size_t head;                           // Next slot to fill
+    std::size_t tail;                           // Next slot to write
+    std::size_t used;
+    bool closing;
+    std::mutex lock;
+    std::condition_variable cv;
+    std::thread writer;
+
+    uint64_t frames;
+    uint64_t bytes;
+    uint64_t stalls;                            // Captures that had to wait for the writer
+
+    void Write()
+    {
+        std::vector<uint8_t> header;
+        std::unique_lock<std::mutex> guard(lock);
+        while (true)
+        {
+            cv.wait(guard, [this]() { return used || closing; });
+            if (!used)
+                break;
+
+            // The slot is ours until we release it
+            auto & slot = ring[tail];
+            guard.unlock();
+
+            header.clear();
+            PutVarint(header, slot.data.size());
+            os.write(reinterpret_cast<const char*>(header.data()), header.size());
+            os.write(reinterpret_cast<const char*>(slot.data.data()), slot.data.size());
+
+            guard.lock();
+            bytes += header.size() + slot.data.size();
+            tail = (tail + 1) % ring.size();
+            --used;
+            cv.notify_all();
+        }
+        os.flush();
+    }
+
+public:
+    Recorder(uint16_t w, uint16_t h, std::size_t queue = 64) : width{w}, height{h}, prev((w * h + 7) / 8),
+                                                               ring(std::max<std::size_t>(queue, 1)), head{0}, tail{0}, used{0},
+                                                               closing{false}, frames{0}, bytes{0}, stalls{0}
+    {
+        for (auto & s : ring)
+            s.data.reserve(MaxPayload(prev.size()));
+    }
+
+    virtual ~Recorder() { Close(); };
+
+    bool Open(const std::string & file, uint8_t fps = 60)
+    {
+        os.open(file, std::ios::out | std::ios::binary | std::ios::trunc);
+        if (!os.is_open())
+            return false;
+
+        const uint8_t header[] = { uint8_t(MAGIC[0]), uint8_t(MAGIC[1]), uint8_t(MAGIC[2]), uint8_t(MAGIC[3]), VERSION,
+                                   uint8_t(width), uint8_t(width >> 8), uint8_t(height), uint8_t(height >> 8), fps };
+        os.write(reinterpret_cast<const char*>(header), sizeof(header));
+        bytes = sizeof(header);
+
+        writer = std::thread(&Recorder::Write, this);
+        return true;
+    }
+
+    bool IsOpen() const { return writer.joinable(); };
+
+    // frame points to width * height bits, MSB first, row major
+    void Capture(const uint8_t * frame)
+    {
+        if (!IsOpen())
+            return;
+
+        std::unique_lock<std::mutex> guard(lock);
+        if (used == ring.size())
+        {
+            ++stalls;
+            cv.wait(guard, [this]() { return used < ring.size(); });
+        }
+        auto & slot = ring[head];
+        guard.unlock();
+
+        // Only the producer touches prev and the slot at head
+        slot.data.clear();
+        EncodeDelta(prev, frame, slot.data);
+
+        guard.lock();
+        head = (head + 1) % ring.size();
+        ++used;
+        ++frames;
+        cv.notify_all();
+    }
+
+    // Writes whatever is queued and closes the file
+    void Close()
+    {
+        if (!IsOpen())
+            return;
+
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            closing = true;
+        }
+        cv.notify_all();
+        writer.join();
+        os.close();
+    }
+
+    uint64_t GetFrames() const { return frames; };
+    uint64_t GetBytes() const { return bytes; };
+    uint64_t GetStalls() const { return stalls; };
+};
+
+// Sequential reader of a capture file
+class Reader
+{
+protected:
+    std::ifstream is;
+    uint16_t width;
+    uint16_t height;
+    uint8_t fps;
+    std::vector<uint8_t> frame;
+    std::vector<uint8_t> payload;
+    bool error;
+
+public:
+    Reader() : width{0}, height{0}, fps{0}, error{false} { };
+
+    bool Open(const std::string & file)
+    {
+        is.open(file, std::ios::in | std::ios::binary);
+        if (!is.is_open())
+            return false;
+
+        uint8_t header[10];
+        if (!is.read(reinterpret_cast<char*>(header), sizeof(header))
+            || !std::equal(MAGIC, MAGIC + 4, header, [](char a, uint8_t b) { return uint8_t(a) == b; }) || header[4] != VERSION)
+            return false;
+
+        width = header[5] | header[6] << 8;
+        height = header[7] | header[8] << 8;
+        fps = header[9];
+        frame.assign((width * height + 7) / 8, 0);
+        return width && height;
+    }
+
+    // Decodes the next frame. False at the end of the file or on a malformed one (see IsError).
+    bool Next()
+    {
+        uint32_t size = 0;
+        int shift = 0;
+        for (int c; (c = is.get()) != EOF; shift += 7)
+        {
+            size |= uint32_t(c & 0x7f) << shift;
+            if (!(c & 0x80))
+                break;
+            if (shift > 28)
+                return !(error = true);
+        }
+        if (is.eof())
+        {
+            error = shift != 0;
+            return false;
+        }
+
+        // A corrupt size must not make the payload allocate gigabytes before the read fails
+        if (size > MaxPayload(frame.size()))
+            return !(error = true);
+
+        payload.resize(size);
+        if (!is.read(reinterpret_cast<char*>(payload.data()), size) || !DecodeDelta(payload.data(), payload.data() + size, frame))
+            return !(error = true);
+        return true;
+    }
+
+    uint16_t GetW() const { return width; };
+    uint16_t GetH() const { return height; };
+    uint8_t GetFPS() const { return fps; };
+    bool IsError() const { return error; };
+
+    bool Pixel(uint16_t x, uint16_t y) const
+    {
+        const std::size_t bit = y * width + x;
+        return (frame[bit / 8] >> (7 - bit % 8)) & 0x1;
+    }
+
+    const std::vector<uint8_t> & Frame() const { return frame; };
+};
+
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstdint>
+
+// Timing of the CHIP-8 interpreter of the COSMAC VIP, to run ROMs at the speed of the original
+// hardware instead of a hand tuned number of instructions per frame (see CHIP8Core::Timing).
+//
+// The CDP1802 runs at 1.76064 MHz, 8 clocks per machine cycle, which is 3668 machine cycles per
+// 60hz frame. The display interrupt keeps the CPU for the 128 lines the CDP1861 shows (14 cycles
+// a line) plus its entry, exit and the timer decrements; the interpreter gets the rest.
+//
+// Costs are in machine cycles: the fetch and dispatch every instruction goes through, plus the
+// work of its routine. They follow the structure of the interpreter routines and are close to,
+// not exactly, what the hardware takes. Sprite rows are shifted into place one bit at a time,
+// so unaligned sprites cost more the further they are from a byte boundary.
+namespace VIP
+{
+
+const unsigned int CLOCK_HZ = 1760640;
+const unsigned int CLOCKS_PER_CYCLE = 8;
+const unsigned int FRAME_CYCLES = CLOCK_HZ / CLOCKS_PER_CYCLE / 60;
+const unsigned int INTERRUPT_CYCLES = 128 * 14 + 40;
+const unsigned int BUDGET = FRAME_CYCLES - INTERRUPT_CYCLES;   // Left to the interpreter every frame
+
+const unsigned int FETCH = 68;                  // Fetch, decode and dispatch
+
+// Machine cycles of an instruction, given the value of its VX before it runs
+inline unsigned int Cycles(uint16_t op, uint8_t vx)
+{
+    const unsigned int X = (op >> 8) & 0xf, N = op & 0xf, NN = op & 0xff;
+    switch (op >> 12)
+    {
+    case 0x0:
+        if (op == 0x00e0)
+            return FETCH + 24 + 2 * 256;        // One store per byte of the display page
+        if (op == 0x00ee)
+            return FETCH + 10;
+        return FETCH;                           // Machine code: unknown
+    case 0x1: return FETCH + 12;
+    case 0x2: return FETCH + 26;
+    case 0x3: case 0x4: return FETCH + 10;
+    case 0x5: case 0x9: return FETCH + 14;
+    case 0x6: return FETCH + 6;
+    case 0x7: return FETCH + 10;
+    case 0x8: return FETCH + 44;                // Built and run as a small routine in RAM
+    case 0xa: return FETCH + 12;
+    case 0xb: return FETCH + 22;
+    case 0xc: return FETCH + 36;
+    case 0xd: return FETCH + 26 + N * (24 + 8 * (vx % 8));
+    case 0xe: return FETCH + 18;
+    case 0xf:
+        switch (NN)
+        {
+        case 0x07: case 0x15: case 0x18: return FETCH + 10;
+        case 0x0a: return FETCH + 20;
+        case 0x1e: return FETCH + 16;
+        case 0x29: return FETCH + 20;
+        case 0x33: return FETCH + 84 + 16 * (vx / 100 + vx / 10 % 10 + vx % 10);   // Repeated subtraction
+        case 0x55: case 0x65: return FETCH + 14 + 14 * (X + 1);
+        }
+        return FETCH;
+    }
+    return FETCH;
+}
+
+}
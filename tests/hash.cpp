@@ -0,0 +1,140 @@
+// chip8-test-hash: the RAM and state hashes CHIP8Core keeps up to date on every write must
+// equal a full recompute after every instruction, and after every way of replacing the state
+// wholesale: LoadState, ResetToBaseline and Memory::Update. Runs the given ROMs and random
+// ones with random keys; exits non zero on the first mismatch.
+
+#include <random>
+#include <vector>
+#include <string>
+#include <iostream>
+
+#include "src/machine.h"
+#include "src/headless.h"
+#include "src/tools/corpus.h"
+
+namespace
+{
+
+typedef CHIP8Core<HeadlessBackend> Headless;
+
+const unsigned int FRAMES = 120;
+const unsigned int IPF = 50;
+
+uint64_t checks = 0;
+
+bool Check(Headless & m, const std::string & what)
+{
+    ++checks;
+    if (m.GetRam().Hash() == m.GetRam().FullHash() && m.StateHash() == m.FullStateHash())
+        return true;
+
+    std::cerr << what << ": incremental hash does not match the recompute at PC " << std::hex << m.GetPC() << std::dec << "\n";
+    return false;
+}
+
+// Steps one instruction at a time, saving a state midway and going back to it and to the
+// baseline at the end
+bool Run(const std::vector<uint8_t> & rom, const std::string & name, std::mt19937_64 & gen)
+{
+    auto m = std::make_unique<Headless>();
+    if (!m->LoadROM(rom.data(), rom.size()))
+    {
+        std::cerr << "Error loading ROM " << name << "\n";
+        return false;
+    }
+    m->SetBaseline();
+    if (!Check(*m, name + " after load"))
+        return false;
+
+    CHIP8State midway;
+    for (unsigned int f=0; f<FRAMES && m->IsRunning(); ++f)
+    {
+        m->GetInput().SetKeys((gen() % 4) ? 0 : 1 << (gen() % 16));
+        for (unsigned int i=0; i<IPF && m->IsRunning(); ++i)
+        {
+            m->Task();
+            if (!Check(*m, name + " frame " + std::to_string(f)))
+                return false;
+        }
+        m->TickTimers();
+        if (f == FRAMES / 2)
+            m->SaveState(midway);
+    }
+
+    m->LoadState(midway);
+    if (!Check(*m, name + " after LoadState"))
+        return false;
+
+    m->ResetToBaseline();
+    return Check(*m, name + " after ResetToBaseline");
+}
+
+// Random ROMs are mostly unknown opcodes; bias them towards real instructions
+std::vector<uint8_t> RandomROM(std::mt19937_64 & gen)
+{
+    std::vector<uint8_t> rom;
+    for (auto n = 1 + gen() % 256; n; --n)
+    {
+        uint16_t op = gen();
+        if (op >> 12 == 0x0)
+            op = (gen() % 2) ? 0x00e0 : 0x00ee;
+        rom.push_back(op >> 8);
+        rom.push_back(op);
+    }
+    return rom;
+}
+
+// Bulk updates straight on a Memory, with runs that are equal, partly equal and wrapping
+bool Updates(std::mt19937_64 & gen)
+{
+    Headless::MemorySpecs ram;
+    std::vector<uint8_t> image(ram.size());
+    for (unsigned int u=0; u<2000; ++u)
+    {
+        const auto addr = gen() % ram.size();
+        const auto length = 1 + gen() % (2 * Headless::MemorySpecs::PageSize);
+        for (std::size_t i=0; i<length; ++i)
+            image[i] = (gen() % 2) ? ram.Read(addr + i) : uint8_t(gen());
+
+        ram.Update(addr, image.begin(), image.begin() + length);
+        ++checks;
+        if (ram.Hash() != ram.FullHash())
+        {
+            std::cerr << "Memory::Update: incremental hash does not match the recompute\n";
+            return false;
+        }
+    }
+    return true;
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+    uint64_t random = 200;
+    std::vector<std::filesystem::path> corpus;
+
+    for (auto i=1; i<argc; ++i)
+    {
+        const std::string arg{argv[i]};
+        if (arg == "--random" && i + 1 < argc)
+            random = std::stoull(argv[++i]);
+        else
+            AddToCorpus(corpus, arg);
+    }
+
+    // Unknown opcodes are reported on the standard output, far too often to be useful here
+    std::cout.rdbuf(nullptr);
+
+    std::mt19937_64 gen(1);
+    bool ok = Updates(gen);
+
+    for (auto & path : corpus)
+        ok = ok && Run(ReadROM(path), path.string(), gen);
+
+    for (uint64_t r=0; r<random && ok; ++r)
+        ok = Run(RandomROM(gen), "random ROM " + std::to_string(r), gen);
+
+    std::clog << checks << " hash checks, " << (ok ? "all passed" : "failed") << std::endl;
+    return ok ? 0 : 1;
+}